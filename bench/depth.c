@@ -0,0 +1,168 @@
+// nests expressions (and IFs) a million deep, to check the parser, optimiser
+// and compiler get through them without recursing and that the answer's still
+// right. then checks the default limit turns the same programs into an error,
+// and that a limit of n allows exactly n frames
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+#include "optimiser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "value.h"
+
+#define DEPTH 1000000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void repeat(StringBuilder *code, char *string, size_t times) {
+	size_t length = strlen(string);
+	for (size_t i = 0; i < times; i++) builder_append(code, string, length);
+}
+
+// every program leaves its answer in a
+typedef struct {
+	char *name;
+	char *setup; // before the line that nests
+	char *open, *middle, *close; // the nesting line is open DEPTH times, middle, then close DEPTH times
+	double expected;
+	bool limited; // whether max_depth applies
+} Case;
+
+static const Case cases[] = {
+	{ "parentheses", "", "(", "2", ")", 2, true },
+	{ "negations", "", "-", "3", "", 3, true }, // DEPTH is even
+	{ "right operands", "let b = 1\n", "b + (", "b", ")", DEPTH + 1, true },
+	{ "powers", "let b = 1\n", "b ^ ", "b", "", 1, true },
+	{ "builtins", "", "abs(", "-5", ")", 5, true },
+	{ "if chain", "let a = 0\n", "if 1 then ", "let a = 7", "", 7, false }
+};
+
+static char *make_program(const Case *test) {
+	StringBuilder code = new_string_builder(64);
+	builder_append_str(&code, test->setup);
+	if (test->limited) builder_append_str(&code, "let a = ");
+
+	repeat(&code, test->open, DEPTH);
+	builder_append_str(&code, test->middle);
+	repeat(&code, test->close, DEPTH);
+	builder_append_char(&code, '\n');
+
+	return code.chars;
+}
+
+static size_t run_case(const Case *test) {
+	char *code = make_program(test);
+
+	max_depth = 0;
+	double start = now();
+	ParserResult parser_result = parse(code);
+	double parse_time = now() - start;
+
+	if (!parser_result.success) {
+		printf("Error: %s didn't parse: %s\n", test->name, parser_result.result.errors.errors[0].message);
+		free_error_list(parser_result.result.errors);
+		free(code);
+		return 1;
+	}
+
+	AST ast = parser_result.result.ast;
+	start = now();
+	optimise_ast(&ast);
+	double optimise_time = now() - start;
+
+	start = now();
+	CompileResult compile_result = compile(ast);
+	double compile_time = now() - start;
+	free_ast(ast);
+
+	if (!compile_result.success) {
+		printf("Error: %s didn't compile\n", test->name);
+		free(code);
+		return 1;
+	}
+
+	Program program = compile_result.result.program;
+	Value *variables = new_variables(&program);
+
+	start = now();
+	run_program_with_variables(&program, variables);
+	double run_time = now() - start;
+
+	size_t a = 0;
+	while (a < program.variables_length && strcmp(program.variables[a], "a") != 0) a++;
+
+	size_t wrong = 0;
+	double result = a < program.variables_length ? value_number(variables[a]) : 0;
+	if (result != test->expected) {
+		printf("Error: %s gave %g, not %g\n", test->name, result, test->expected);
+		wrong++;
+	}
+
+	free_variables(&program, variables);
+	free_program(program);
+
+	// with the default limit it should stop with an error instead
+	max_depth = DEFAULT_MAX_DEPTH;
+	parser_result = parse(code);
+
+	if (parser_result.success) {
+		if (test->limited) {
+			printf("Error: %s parsed past the default limit\n", test->name);
+			wrong++;
+		}
+		free_ast(parser_result.result.ast);
+	} else {
+		ErrorList errors = parser_result.result.errors;
+		if (!test->limited || errors.length != 1 || strstr(errors.errors[0].message, "nested more than") == NULL) {
+			printf("Error: %s failed with: %s\n", test->name, errors.errors[0].message);
+			wrong++;
+		}
+		free_error_list(errors);
+	}
+
+	printf(
+		"%-15s parse %7.3fs   optimise %7.3fs   compile %7.3fs   run %7.3fs\n", test->name,
+		parse_time, optimise_time, compile_time, run_time
+	);
+
+	free(code);
+	return wrong;
+}
+
+// "let a = ((((1))))" is five frames deep, the outermost expression included
+static size_t check_limit(void) {
+	char *code = "let a = ((((1))))\n";
+	size_t wrong = 0;
+
+	for (max_depth = 4; max_depth <= 5; max_depth++) {
+		ParserResult parser_result = parse(code);
+		bool expected = max_depth == 5;
+
+		if (parser_result.success) free_ast(parser_result.result.ast);
+		else free_error_list(parser_result.result.errors);
+
+		if (parser_result.success != expected) {
+			printf("Error: a limit of %zu %s five frames\n", max_depth, expected ? "didn't allow" : "allowed");
+			wrong++;
+		}
+	}
+
+	return wrong;
+}
+
+int main(void) {
+	size_t wrong = check_limit();
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+		wrong += run_case(&cases[i]);
+
+	printf("%d deep, wrong results: %zu\n", DEPTH, wrong);
+	return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+// compares evaluating deep expressions stored the old way (a tree of Exprs
+// pointing to separately allocated argument lists) against sweeping the
+// post-order expression pool the parser builds now
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "parser.h"
+#include "arena.h"
+#include "builtins.h"
+
+#define EXPRESSIONS 2000
+#define DEPTH 12
+#define VARIABLES 26
+#define RUNS 50
+#define MAX_STACK 256
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// the layout expressions had before the pool
+struct OldExprList;
+
+typedef struct {
+	ExprKind type;
+	union {
+		double number_literal;
+		Symbol variable;
+		struct {
+			int builtin;
+			char name_char;
+			struct OldExprList *args;
+		} call;
+	} expr;
+} OldExpr;
+
+typedef struct OldExprList {
+	OldExpr *exprs;
+	size_t length;
+} OldExprList;
+
+static OldExpr to_old_expr(Arena *arena, ExprPool *pool, ExprIndex index) {
+	OldExpr expr = { pool->kinds[index], { 0 } };
+	size_t arg_count = pool->kinds[index] == EXPR_BINARY ? 2 : 1;
+
+	switch (pool->kinds[index]) {
+		case EXPR_NUMBER: expr.expr.number_literal = pool->values[index].number; return expr;
+		case EXPR_VAR: expr.expr.variable = pool->values[index].variable; return expr;
+		default: break;
+	}
+
+	OldExprList *args = arena_alloc(arena, sizeof(OldExprList) + sizeof(OldExpr) * arg_count);
+	args->exprs = (OldExpr *)(args + 1);
+	args->length = arg_count;
+
+	if (arg_count == 2) {
+		args->exprs[0] = to_old_expr(arena, pool, pool->values[index].lhs);
+		args->exprs[1] = to_old_expr(arena, pool, index - 1);
+	} else {
+		args->exprs[0] = to_old_expr(arena, pool, index - 1);
+	}
+
+	expr.expr.call.builtin = pool->kinds[index] == EXPR_BUILTIN ? pool->ops[index] : -1;
+	expr.expr.call.name_char = pool->ops[index];
+	expr.expr.call.args = args;
+
+	return expr;
+}
+
+static inline double apply(char op, double lhs, double rhs) {
+	switch (op) {
+		case '+': return lhs + rhs;
+		case '-': return lhs - rhs;
+		case '*': return lhs * rhs;
+		case '/': return lhs / rhs;
+		default: return pow(lhs, rhs);
+	}
+}
+
+static double evaluate_tree(OldExpr expr, double *variables) {
+	switch (expr.type) {
+		case EXPR_NUMBER: return expr.expr.number_literal;
+		case EXPR_VAR: return variables[expr.expr.variable];
+		default: {
+			OldExprList *args = expr.expr.call.args;
+
+			if (expr.expr.call.builtin != -1)
+				return builtins[expr.expr.call.builtin].function(evaluate_tree(args->exprs[0], variables));
+
+			double lhs = evaluate_tree(args->exprs[0], variables);
+			if (args->length == 1) return -lhs;
+			return apply(expr.expr.call.name_char, lhs, evaluate_tree(args->exprs[1], variables));
+		}
+	}
+}
+
+static double evaluate_pool(ExprPool *pool, ExprIndex root, double *variables) {
+	double stack[MAX_STACK];
+	size_t top = 0;
+
+	for (ExprIndex i = expr_start(pool, root); i <= root; i++) {
+		switch (pool->kinds[i]) {
+			case EXPR_NUMBER: stack[top++] = pool->values[i].number; break;
+			case EXPR_VAR: stack[top++] = variables[pool->values[i].variable]; break;
+			case EXPR_NEGATE: stack[top - 1] = -stack[top - 1]; break;
+			case EXPR_BUILTIN: stack[top - 1] = builtins[pool->ops[i]].function(stack[top - 1]); break;
+			case EXPR_BINARY:
+				top--;
+				stack[top - 1] = apply(pool->ops[i], stack[top - 1], stack[top]);
+				break;
+		}
+	}
+
+	return stack[0];
+}
+
+static void generate_expr(StringBuilder *code, int depth) {
+	char buffer[32];
+
+	if (depth == 0 || rand() % 8 == 0) {
+		if (rand() % 2) snprintf(buffer, sizeof(buffer), "v%c", 'a' + rand() % VARIABLES);
+		else snprintf(buffer, sizeof(buffer), "%d.5", rand() % 10);
+		builder_append_str(code, buffer);
+		return;
+	}
+
+	switch (rand() % 6) {
+		case 0:
+			builder_append_str(code, "-(");
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+			break;
+		case 1:
+			builder_append_str(code, "abs(");
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+			break;
+		default:
+			builder_append_str(code, "(");
+			generate_expr(code, depth - 1);
+			snprintf(buffer, sizeof(buffer), " %c ", "+-*/"[rand() % 4]);
+			builder_append_str(code, buffer);
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+	}
+}
+
+int main(void) {
+	StringBuilder code = new_string_builder(4096);
+
+	srand(5);
+	for (size_t i = 0; i < EXPRESSIONS; i++) {
+		builder_append_str(&code, "let vz = ");
+		generate_expr(&code, DEPTH);
+		builder_append_str(&code, "\n");
+	}
+
+	ParserResult parser_result = parse(code.chars);
+
+	if (!parser_result.success) {
+		printf("Error: generated program didn't parse\n");
+		return EXIT_FAILURE;
+	}
+
+	AST ast = parser_result.result.ast;
+	Arena arena = new_arena(ARENA_CHUNK_SIZE);
+	OldExpr *trees = malloc(sizeof(OldExpr) * ast.length);
+
+	for (size_t i = 0; i < ast.length; i++)
+		trees[i] = to_old_expr(&arena, &ast.exprs, ast.statements[i].statement.assignment.expr);
+
+	double *variables = calloc(ast.symbols.length, sizeof(double));
+	for (size_t i = 0; i < ast.symbols.length; i++)
+		variables[i] = i + 0.25;
+
+	double *tree_results = malloc(sizeof(double) * ast.length);
+	double *pool_results = malloc(sizeof(double) * ast.length);
+
+	double start = now();
+	for (size_t run = 0; run < RUNS; run++)
+		for (size_t i = 0; i < ast.length; i++)
+			tree_results[i] = evaluate_tree(trees[i], variables);
+	double tree_time = now() - start;
+
+	start = now();
+	for (size_t run = 0; run < RUNS; run++)
+		for (size_t i = 0; i < ast.length; i++)
+			pool_results[i] = evaluate_pool(&ast.exprs, ast.statements[i].statement.assignment.expr, variables);
+	double pool_time = now() - start;
+
+	size_t nodes = ast.exprs.length * RUNS;
+	printf("pointer tree: %8.3fs  %10.0f nodes/s\n", tree_time, nodes / tree_time);
+	printf("pool sweep:   %8.3fs  %10.0f nodes/s\n", pool_time, nodes / pool_time);
+	printf("speedup:      %8.2fx\n", tree_time / pool_time);
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < ast.length; i++)
+		if (memcmp(&tree_results[i], &pool_results[i], sizeof(double)) != 0) mismatches++;
+
+	if (mismatches > 0) printf("Error: layouts disagree on %zu expressions\n", mismatches);
+
+	free(tree_results);
+	free(pool_results);
+	free(variables);
+	free(trees);
+	free_arena(&arena);
+	free_ast(ast);
+	free(code.chars);
+
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
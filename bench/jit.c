@@ -0,0 +1,154 @@
+// checks that compiled assignments leave every variable with exactly the same
+// bits as the interpreter does (apart from which nan), then compares how fast
+// a loop over them runs with the jit off, on and always on
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "utils.h"
+
+#define VARIABLES 25
+#define STATEMENTS 400
+#define DEPTH 5
+#define ITERATIONS 2000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void generate_expr(StringBuilder *code, int depth) {
+	static char *functions[] = { "abs", "sqr", "sin", "cos", "int", "sgn", "atn", "exp", "log" };
+	char buffer[32];
+
+	if (depth == 0 || rand() % 6 == 0) {
+		if (rand() % 2) snprintf(buffer, sizeof(buffer), "v%c", 'a' + rand() % VARIABLES);
+		else snprintf(buffer, sizeof(buffer), "%d.%d", rand() % 10, rand() % 100);
+		builder_append_str(code, buffer);
+		return;
+	}
+
+	switch (rand() % 7) {
+		case 0:
+			builder_append_str(code, "-(");
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+			break;
+		case 1:
+			builder_append_str(code, functions[rand() % (sizeof(functions) / sizeof(*functions))]);
+			builder_append_str(code, "(");
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+			break;
+		default:
+			builder_append_str(code, "(");
+			generate_expr(code, depth - 1);
+			snprintf(buffer, sizeof(buffer), " %c ", "+-*/^"[rand() % 5]);
+			builder_append_str(code, buffer);
+			generate_expr(code, depth - 1);
+			builder_append_str(code, ")");
+	}
+}
+
+// a loop over random assignments, with some that stay finite mixed in so the
+// values don't all end up as infinities or nans
+static char *generate_program(void) {
+	StringBuilder code = new_string_builder(4096);
+	char line[256];
+
+	srand(3);
+	builder_append_str(&code, "10 let count = count + 1\n");
+
+	for (size_t i = 0; i < STATEMENTS; i++) {
+		if (i % 2 == 0) {
+			snprintf(line, sizeof(line), "let v%c = ", 'a' + rand() % VARIABLES);
+			builder_append_str(&code, line);
+			generate_expr(&code, DEPTH);
+			builder_append_str(&code, "\n");
+		} else {
+			char a = 'a' + rand() % VARIABLES, b = 'a' + rand() % VARIABLES;
+			snprintf(
+				line, sizeof(line), "let v%c = (v%c + %d.5) * abs(v%c - %d) / (%d + v%c ^ 2) - -v%c\n",
+				'a' + rand() % VARIABLES, a, rand() % 9 + 1, b, rand() % 9 + 1, rand() % 9 + 1, b, a
+			);
+			builder_append_str(&code, line);
+		}
+	}
+
+	snprintf(line, sizeof(line), "if count < %d then 10\n", ITERATIONS);
+	builder_append_str(&code, line);
+
+	return code.chars;
+}
+
+static bool same_value(Value a, Value b) {
+	return a == b || (isnan(value_number(a)) && isnan(value_number(b)));
+}
+
+static double time_run(Program *program, JitMode mode, Value **variables) {
+	jit_mode = mode;
+	*variables = new_variables(program);
+
+	double start = now();
+	run_program_with_variables(program, *variables);
+	return now() - start;
+}
+
+int main(void) {
+	char *code = generate_program();
+	ParserResult parser_result = parse(code);
+
+	if (!parser_result.success) {
+		printf("Error: generated program didn't parse\n");
+		return EXIT_FAILURE;
+	}
+
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+
+	if (!compile_result.success) {
+		printf("Error: generated program didn't compile\n");
+		return EXIT_FAILURE;
+	}
+
+	Program program = compile_result.result.program;
+	Value *interpreted, *hot, *always;
+
+	double off_time = time_run(&program, JIT_OFF, &interpreted);
+	double on_time = time_run(&program, JIT_ON, &hot);
+	double always_time = time_run(&program, JIT_ALWAYS, &always);
+
+	// any nan matches any other, since which one comes out of an operation on
+	// two of them depends on how the compiler ordered the operands
+	size_t mismatches = 0;
+	for (size_t i = 0; i < program.variables_length; i++) {
+		mismatches += !same_value(interpreted[i], hot[i]);
+		mismatches += !same_value(interpreted[i], always[i]);
+	}
+
+	double statements = (double)(STATEMENTS + 2) * ITERATIONS;
+	printf("interpreter: %8.3fs  %10.0f statements/s\n", off_time, statements / off_time);
+	printf("jit on:      %8.3fs  %10.0f statements/s\n", on_time, statements / on_time);
+	printf("jit always:  %8.3fs  %10.0f statements/s\n", always_time, statements / always_time);
+	printf("speedup:     %8.2fx\n", off_time / on_time);
+	printf("mismatches:  %zu of %zu variables\n", mismatches, program.variables_length * 2);
+
+#ifndef HAVE_JIT
+	printf("(the jit isn't available on this platform, so everything was interpreted)\n");
+#endif
+
+	free_variables(&program, interpreted);
+	free_variables(&program, hot);
+	free_variables(&program, always);
+	free_program(program);
+	free(code);
+
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
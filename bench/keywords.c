@@ -0,0 +1,89 @@
+// compares the keyword table against the old approach of trying each keyword
+// in turn, as the number of keywords grows
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "lexer.h"
+
+#define WORDS 1000000
+#define ROUNDS 20
+
+// the keywords a full BASIC would have, in the order they'd be tried
+static char *basic_keywords[] = {
+	"let", "print", "rem", "goto", "gosub", "return", "if", "then", "else", "end",
+	"for", "to", "step", "next", "input", "dim", "data", "read", "restore", "stop",
+	"on", "def", "fn", "and", "or", "not", "while", "wend", "randomize", "cls"
+};
+
+static char *identifiers[] = {
+	"x", "total", "letter", "remainder", "printer", "count$", "index", "value", "delta", "name$"
+};
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// what the lexer used to do: a case insensitive prefix match per keyword
+static bool case_insensitive_match(char *code, char *str) {
+	for (size_t i = 0; i < strlen(str); i++)
+		if (tolower(code[i]) != tolower(str[i]))
+			return false;
+
+	return true;
+}
+
+static int linear_lookup(char *word, size_t keyword_count) {
+	for (size_t i = 0; i < keyword_count; i++)
+		if (case_insensitive_match(word, basic_keywords[i]))
+			return i;
+
+	return -1;
+}
+
+int main(void) {
+	char **words = malloc(WORDS * sizeof(char *));
+	size_t *lengths = malloc(WORDS * sizeof(size_t));
+
+	// mostly identifiers with some of the keywords the lexer knows about
+	char *known_keywords[] = { "LET", "print", "Rem" };
+	srand(1);
+	for (size_t i = 0; i < WORDS; i++) {
+		words[i] = rand() % 4 == 0 ? known_keywords[rand() % 3] : identifiers[rand() % 10];
+		lengths[i] = strlen(words[i]);
+	}
+
+	size_t found = 0;
+	double start = now();
+	for (size_t round = 0; round < ROUNDS; round++)
+		for (size_t i = 0; i < WORDS; i++)
+			found += lookup_keyword(words[i], lengths[i]) != NULL;
+	double table_time = now() - start;
+
+	printf("keyword table:       %6.2f ns/word  (%zu keywords found)\n", table_time / (WORDS * ROUNDS) * 1e9, found);
+
+	size_t keyword_counts[] = { 3, 10, 20, 30 };
+	for (size_t k = 0; k < sizeof(keyword_counts) / sizeof(size_t); k++) {
+		found = 0;
+		start = now();
+		for (size_t round = 0; round < ROUNDS; round++)
+			for (size_t i = 0; i < WORDS; i++)
+				found += linear_lookup(words[i], keyword_counts[k]) != -1;
+		double linear_time = now() - start;
+
+		printf(
+			"linear, %2zu keywords: %6.2f ns/word  (%zu prefix matches)\n",
+			keyword_counts[k], linear_time / (WORDS * ROUNDS) * 1e9, found
+		);
+	}
+
+	free(words);
+	free(lengths);
+
+	return EXIT_SUCCESS;
+}
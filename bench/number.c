@@ -0,0 +1,84 @@
+// checks decimal_to_double against strtod on a corpus of generated literals
+// and compares how fast the two are
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "number.h"
+
+#define LITERALS 1000000
+#define MAX_LITERAL_LENGTH 32
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// makes literals like the ones the lexer sees: mostly short, with the odd
+// long one (or leading zeros) to push things onto the slow path
+static size_t generate_literal(char *buffer) {
+	size_t integer_digits = rand() % 8;
+	size_t fraction_digits = rand() % 4 == 0 ? rand() % 24 : rand() % 6;
+	size_t length = 0;
+
+	for (size_t i = 0; i < integer_digits; i++)
+		buffer[length++] = '0' + rand() % 10;
+
+	if (fraction_digits > 0 || integer_digits == 0) {
+		buffer[length++] = '.';
+		for (size_t i = 0; i < fraction_digits; i++)
+			buffer[length++] = '0' + rand() % 10;
+	}
+
+	buffer[length] = '\0';
+	return length;
+}
+
+int main(void) {
+	char *literals = malloc(LITERALS * MAX_LITERAL_LENGTH);
+	size_t *lengths = malloc(LITERALS * sizeof(size_t));
+	double *results = malloc(LITERALS * sizeof(double));
+	size_t total_length = 0;
+
+	srand(1);
+	for (size_t i = 0; i < LITERALS; i++) {
+		lengths[i] = generate_literal(literals + i * MAX_LITERAL_LENGTH);
+		total_length += lengths[i];
+	}
+
+	double start = now();
+	for (size_t i = 0; i < LITERALS; i++)
+		results[i] = strtod(literals + i * MAX_LITERAL_LENGTH, NULL);
+	double strtod_time = now() - start;
+
+	size_t mismatches = 0;
+	double checksum = 0;
+
+	start = now();
+	for (size_t i = 0; i < LITERALS; i++)
+		checksum += decimal_to_double(literals + i * MAX_LITERAL_LENGTH, lengths[i]);
+	double fast_time = now() - start;
+
+	for (size_t i = 0; i < LITERALS; i++) {
+		char *literal = literals + i * MAX_LITERAL_LENGTH;
+		double number = decimal_to_double(literal, lengths[i]);
+
+		if (memcmp(&number, &results[i], sizeof(double)) != 0) {
+			if (mismatches++ < 10)
+				printf("mismatch: %s -> %.17g (strtod gives %.17g)\n", literal, number, results[i]);
+		}
+	}
+
+	printf("strtod:            %8.3fs  %6.1f MB/s\n", strtod_time, total_length / strtod_time / 1e6);
+	printf("decimal_to_double: %8.3fs  %6.1f MB/s  (checksum %g)\n", fast_time, total_length / fast_time / 1e6, checksum);
+	printf("mismatches:        %zu of %d\n", mismatches, LITERALS);
+
+	free(literals);
+	free(lengths);
+	free(results);
+
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
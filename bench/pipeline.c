@@ -0,0 +1,385 @@
+// end to end numbers for lexing and parsing generated programs, printed as
+// json so they can be kept and compared between releases. run it with
+// --emit and any of the knobs below to get the generated program instead:
+//
+//   --bytes N        roughly how big the program should be
+//   --depth N        how deeply expressions can nest
+//   --identifiers F  chance of an operand being a variable instead of a number
+//   --strings F      chance of a printed item being a string literal
+//   --comments F     fraction of lines which are comments
+//   --errors F       fraction of lines with a syntax error in them
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "symbols.h"
+#include "parallel.h"
+#include "workers.h"
+
+#define ROUNDS 5
+#define MAX_DEPTH 8
+#define MAX_LINE_LENGTH 65536
+#define NAMES 200
+
+typedef struct {
+	char *name;
+	size_t bytes;
+	int depth;
+	double identifiers;
+	double strings;
+	double comments;
+	double errors;
+} Workload;
+
+static const Workload workloads[] = {
+	{ "mixed",    4 << 20, 4, 0.5, 0.3, 0.2, 0.0 },
+	{ "deep",     4 << 20, 8, 0.5, 0.0, 0.0, 0.0 },
+	{ "strings",  4 << 20, 2, 0.3, 0.9, 0.1, 0.0 },
+	{ "comments", 4 << 20, 3, 0.5, 0.3, 0.8, 0.0 },
+	{ "errors",   4 << 20, 4, 0.5, 0.3, 0.2, 0.01 },
+};
+
+// allocations are counted by replacing malloc and friends with versions that
+// count and then call glibc's own. anywhere else the counts just stay at 0
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+	allocations++;
+	allocated_bytes += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+	allocations++;
+	allocated_bytes += count * size;
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	allocations++;
+	allocated_bytes += size;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+#endif
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static double chance(void) {
+	return rand() / (RAND_MAX + 1.0);
+}
+
+// names can't have digits in them, and starting them all with v keeps them
+// clear of the keywords
+static void write_name(char *buffer, size_t index) {
+	size_t length = 0;
+	buffer[length++] = 'v';
+	do {
+		buffer[length++] = 'a' + index % 26;
+		index /= 26;
+	} while (index > 0);
+	buffer[length] = '\0';
+}
+
+static const char *builtin_names[] = { "abs", "int", "sgn", "sqr", "sin", "cos", "atn", "exp" };
+
+static char *generate_expr(char *out, const Workload *workload, int depth) {
+	if (depth == 0 || chance() < 0.25) {
+		if (chance() < workload->identifiers) {
+			char name[16];
+			write_name(name, rand() % NAMES);
+			return out + sprintf(out, "%s", name);
+		}
+
+		if (chance() < 0.5)
+			return out + sprintf(out, "%d", rand() % 1000);
+		return out + sprintf(out, "%d.%d", rand() % 100, rand() % 1000);
+	}
+
+	switch (rand() % 8) {
+		case 0:
+			*out++ = '(';
+			out = generate_expr(out, workload, depth - 1);
+			*out++ = ')';
+			return out;
+		case 1:
+			*out++ = '-';
+			return generate_expr(out, workload, depth - 1);
+		case 2:
+			out += sprintf(out, "%s(", builtin_names[rand() % (sizeof(builtin_names) / sizeof(*builtin_names))]);
+			out = generate_expr(out, workload, depth - 1);
+			*out++ = ')';
+			return out;
+		default:
+			out = generate_expr(out, workload, depth - 1);
+			out += sprintf(out, " %c ", "+-*/+-*^"[rand() % 8]);
+			return generate_expr(out, workload, depth - 1);
+	}
+}
+
+static char *generate_string(char *out) {
+	static const char *words[] = { "the", "value", "of", "total", "is", "now", "hello", "result" };
+	size_t word_count = rand() % 6 + 1;
+
+	*out++ = '"';
+	for (size_t i = 0; i < word_count; i++) {
+		if (i > 0) *out++ = ' ';
+		out += sprintf(out, "%s", words[rand() % (sizeof(words) / sizeof(*words))]);
+	}
+	*out++ = '"';
+
+	return out;
+}
+
+static char *generate_line(char *out, const Workload *workload) {
+	char name[16];
+
+	// an operator with nothing after it, which is found right at the end of the
+	// line so recovery has as little as possible left to skip
+	if (chance() < workload->errors) {
+		write_name(name, rand() % NAMES);
+		out += sprintf(out, "let %s = ", name);
+		out = generate_expr(out, workload, workload->depth);
+		return out + sprintf(out, " +");
+	}
+
+	if (chance() < workload->comments) {
+		out += sprintf(out, rand() % 2 ? "' " : "rem ");
+		return generate_string(out);
+	}
+
+	if (chance() < 0.5) {
+		write_name(name, rand() % NAMES);
+		out += sprintf(out, "let %s = ", name);
+		out = generate_expr(out, workload, workload->depth);
+	} else {
+		size_t items = rand() % 3 + 1;
+		out += sprintf(out, "print ");
+
+		for (size_t i = 0; i < items; i++) {
+			if (i > 0) out += sprintf(out, rand() % 2 ? "; " : ", ");
+
+			if (chance() < workload->strings)
+				out = generate_string(out);
+			else
+				out = generate_expr(out, workload, workload->depth);
+		}
+	}
+
+	return out;
+}
+
+static char *generate_program(const Workload *workload, size_t *length, size_t *lines) {
+	char *code = malloc(workload->bytes + MAX_LINE_LENGTH + 1);
+	char *out = code;
+
+	srand(4);
+	*lines = 0;
+
+	while ((size_t)(out - code) < workload->bytes) {
+		out = generate_line(out, workload);
+		*out++ = '\n';
+		(*lines)++;
+	}
+
+	*out = '\0';
+	*length = out - code;
+	return code;
+}
+
+static size_t peak_rss_kb(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static void bench_workload(const Workload *workload, bool last) {
+	size_t length, lines;
+	char *code = generate_program(workload, &length, &lines);
+
+	double best_lex_time = 1e9;
+	size_t tokens = 0, lex_allocations = 0;
+
+	for (size_t round = 0; round < ROUNDS; round++) {
+		SymbolTable symbols = new_symbol_table();
+		size_t allocations_before = allocations;
+		double start = now();
+
+		// the whole program, lexed the way the parser has it lexed
+		TokenStream stream = new_token_stream(new_lexer(code, 1, &symbols));
+		while (lex_more_tokens(&stream));
+		tokens = stream.length - 1; // not counting the EOF
+
+		double time = now() - start;
+		lex_allocations = allocations - allocations_before;
+
+		if (stream.errors_length > 0) {
+			fprintf(stderr, "%s: generated program didn't lex\n", workload->name);
+			exit(EXIT_FAILURE);
+		}
+
+		free_token_stream(&stream);
+		free_symbol_table(&symbols);
+		if (time < best_lex_time) best_lex_time = time;
+	}
+
+	double best_parse_time = 1e9;
+	size_t parse_allocations = 0, parse_bytes = 0, statements = 0, errors = 0;
+
+	for (size_t round = 0; round < ROUNDS; round++) {
+		size_t allocations_before = allocations, bytes_before = allocated_bytes;
+		double start = now();
+
+		ParserResult result = parse(code);
+
+		double time = now() - start;
+		parse_allocations = allocations - allocations_before;
+		parse_bytes = allocated_bytes - bytes_before;
+
+		if (!result.success && workload->errors == 0) {
+			fprintf(stderr, "%s: generated program didn't parse\n", workload->name);
+			exit(EXIT_FAILURE);
+		}
+
+		if (result.success) {
+			statements = result.result.ast.length;
+			free_ast(result.result.ast);
+		} else {
+			errors = result.result.errors.length;
+			free_error_list(result.result.errors);
+		}
+
+		if (time < best_parse_time) best_parse_time = time;
+	}
+
+	// the same again split across every cpu
+	size_t threads = default_thread_count();
+	double best_parallel_time = 1e9;
+
+	for (size_t round = 0; round < ROUNDS; round++) {
+		double start = now();
+		ParserResult result = parse_parallel(code, length, threads);
+		double time = now() - start;
+
+		size_t count = result.success ? result.result.ast.length : result.result.errors.length;
+		if (result.success != (errors == 0) || count != (result.success ? statements : errors)) {
+			fprintf(stderr, "%s: parallel parse didn't match\n", workload->name);
+			exit(EXIT_FAILURE);
+		}
+
+		if (result.success) free_ast(result.result.ast);
+		else free_error_list(result.result.errors);
+		if (time < best_parallel_time) best_parallel_time = time;
+	}
+
+	free(code);
+
+	printf("    {\n");
+	printf("      \"workload\": \"%s\",\n", workload->name);
+	printf("      \"bytes\": %zu,\n", length);
+	printf("      \"lines\": %zu,\n", lines);
+	printf("      \"depth\": %d,\n", workload->depth);
+	printf("      \"identifiers\": %g,\n", workload->identifiers);
+	printf("      \"strings\": %g,\n", workload->strings);
+	printf("      \"comments\": %g,\n", workload->comments);
+	printf("      \"error_ratio\": %g,\n", workload->errors);
+	printf("      \"tokens\": %zu,\n", tokens);
+	printf("      \"statements\": %zu,\n", statements);
+	printf("      \"errors\": %zu,\n", errors);
+	printf("      \"lex_seconds\": %.6f,\n", best_lex_time);
+	printf("      \"lex_mb_per_second\": %.1f,\n", length / best_lex_time / 1e6);
+	printf("      \"tokens_per_second\": %.0f,\n", tokens / best_lex_time);
+	printf("      \"lex_allocations\": %zu,\n", lex_allocations);
+	printf("      \"parse_seconds\": %.6f,\n", best_parse_time);
+	printf("      \"parse_mb_per_second\": %.1f,\n", length / best_parse_time / 1e6);
+	printf("      \"parse_allocations\": %zu,\n", parse_allocations);
+	printf("      \"parse_allocated_bytes\": %zu,\n", parse_bytes);
+	printf("      \"threads\": %zu,\n", threads);
+	printf("      \"parallel_parse_seconds\": %.6f,\n", best_parallel_time);
+	printf("      \"parallel_speedup\": %.2f,\n", best_parse_time / best_parallel_time);
+	printf("      \"peak_rss_kb\": %zu\n", peak_rss_kb());
+	printf("    }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+	// every error should be counted
+	max_errors = 0;
+
+	Workload custom = workloads[0];
+	custom.name = "custom";
+	bool emit = false, customised = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--emit") == 0) {
+			emit = true;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		char *value = argv[++i];
+		customised = true;
+
+		if (strcmp(argv[i - 1], "--bytes") == 0) custom.bytes = strtoull(value, NULL, 10);
+		else if (strcmp(argv[i - 1], "--depth") == 0) custom.depth = atoi(value);
+		else if (strcmp(argv[i - 1], "--identifiers") == 0) custom.identifiers = atof(value);
+		else if (strcmp(argv[i - 1], "--strings") == 0) custom.strings = atof(value);
+		else if (strcmp(argv[i - 1], "--comments") == 0) custom.comments = atof(value);
+		else if (strcmp(argv[i - 1], "--errors") == 0) custom.errors = atof(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (custom.depth < 0 || custom.depth > MAX_DEPTH) {
+		fprintf(stderr, "Depth has to be between 0 and %d\n", MAX_DEPTH);
+		return EXIT_FAILURE;
+	}
+
+	if (emit) {
+		size_t length, lines;
+		char *code = generate_program(&custom, &length, &lines);
+		fwrite(code, 1, length, stdout);
+		free(code);
+		return EXIT_SUCCESS;
+	}
+
+	printf("{\n  \"rounds\": %d,\n  \"results\": [\n", ROUNDS);
+
+	if (customised) {
+		bench_workload(&custom, true);
+	} else {
+		size_t count = sizeof(workloads) / sizeof(*workloads);
+		for (size_t i = 0; i < count; i++)
+			bench_workload(&workloads[i], i == count - 1);
+	}
+
+	printf("  ]\n}\n");
+
+	return EXIT_SUCCESS;
+}
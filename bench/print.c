@@ -0,0 +1,210 @@
+// checks every number format_number writes reads back as the same double and
+// that commas pad out to the print zones, then compares printing through stdio
+// (printf("%g") for each item, the way PRINT used to work) against the output
+// buffer, with stdout sent to /dev/null
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "number.h"
+#include "output.h"
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "utils.h"
+
+#define CHECK_NUMBERS 2000000
+#define LINES 2000000
+#define ITEMS_PER_LINE 4
+#define PROGRAM_LINES 1000000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint64_t random_bits(void) {
+	return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand() ^ ((uint64_t)rand() << 62);
+}
+
+// half are any bit pattern at all and half look like what programs print
+static double random_number(void) {
+	if (rand() % 2) {
+		uint64_t bits = random_bits();
+		double number;
+		memcpy(&number, &bits, sizeof(double));
+		return number;
+	}
+
+	return (rand() % 2000000 - 1000000) / pow(10, rand() % 7);
+}
+
+// the fewest significant digits printf needs to round trip, to see how often
+// grisu2 gives more than that
+static int shortest_digits(double number) {
+	char buffer[40];
+
+	for (int precision = 1; precision < 17; precision++) {
+		snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, number);
+		if (strtod(buffer, NULL) == number) return precision;
+	}
+
+	return 17;
+}
+
+static int significant_digits(char *formatted) {
+	char *mantissa_end = strchr(formatted, 'e');
+	if (mantissa_end == NULL) mantissa_end = formatted + strlen(formatted);
+
+	int digits = 0, zeros = 0;
+	bool started = false;
+
+	for (char *ch = formatted; ch < mantissa_end; ch++) {
+		if (*ch < '0' || *ch > '9') continue;
+		if (*ch != '0') started = true;
+		if (!started) continue;
+
+		// trailing zeros of a whole number aren't significant
+		if (*ch == '0') zeros++;
+		else {
+			digits += zeros + 1;
+			zeros = 0;
+		}
+	}
+
+	return digits;
+}
+
+// prints a line with every kind of output through the buffer into a temporary
+// file, and compares it with where the zones should put things
+static size_t check_zones(void) {
+	static const char expected[] =
+		"abc           1.5           x\n"
+		"y             12345678901234              .\n";
+
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	FILE *file = tmpfile();
+	dup2(fileno(file), STDOUT_FILENO);
+
+	output_bytes("abc", 3);
+	output_zone();
+	output_number(1.5);
+	output_zone();
+	output_bytes("x\ny", 3);
+	output_zone();
+	output_number(12345678901234);
+	output_zone();
+	output_char('.');
+	output_char('\n');
+	flush_output();
+
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+
+	char got[sizeof(expected)] = { 0 };
+	rewind(file);
+	size_t length = fread(got, 1, sizeof(got) - 1, file);
+	fclose(file);
+
+	if (length == sizeof(expected) - 1 && memcmp(got, expected, length) == 0) return 0;
+	printf("Error: zones came out as \"%s\"\n", got);
+	return 1;
+}
+
+int main(void) {
+	char buffer[FORMATTED_NUMBER_SIZE + 1];
+	size_t wrong_zones = check_zones();
+	size_t wrong = 0, longer = 0, checked = 0;
+
+	srand(4);
+	for (size_t i = 0; i < CHECK_NUMBERS; i++) {
+		double number = random_number();
+		if (!isfinite(number)) continue;
+
+		buffer[format_number(number, buffer)] = '\0';
+		double read_back = strtod(buffer, NULL);
+		checked++;
+
+		if (memcmp(&read_back, &number, sizeof(double)) != 0) {
+			if (wrong++ < 5) printf("Error: %s doesn't read back as %.17g\n", buffer, number);
+		} else if (i % 16 == 0 && significant_digits(buffer) > shortest_digits(number)) {
+			longer++;
+		}
+	}
+
+	double *values = malloc(sizeof(double) * LINES * ITEMS_PER_LINE);
+	for (size_t i = 0; i < LINES * ITEMS_PER_LINE; i++)
+		values[i] = rand() % 4 == 0 ? rand() % 1000 : (rand() % 2000000 - 1000000) / pow(10, rand() % 7);
+
+	StringBuilder code = new_string_builder(4096);
+	char line[128];
+	snprintf(line, sizeof(line), "10 let i = i + 1\nprint i, i / 7; \" \"; i * 0.25\nif i < %d then 10\n", PROGRAM_LINES);
+	builder_append_str(&code, line);
+	ParserResult parser_result = parse(code.chars);
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+	Program program = compile_result.result.program;
+
+	// everything printed from here on goes to /dev/null
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+
+	double start = now();
+	int column = 0;
+	for (size_t i = 0; i < LINES; i++) {
+		for (size_t j = 0; j < ITEMS_PER_LINE; j++) {
+			column += printf("%g", values[i * ITEMS_PER_LINE + j]);
+
+			if (j < ITEMS_PER_LINE - 1) {
+				int padding = PRINT_ZONE_WIDTH - column % PRINT_ZONE_WIDTH;
+				column += printf("%*s", padding, "");
+			} else {
+				putchar('\n');
+				column = 0;
+			}
+		}
+	}
+	fflush(stdout);
+	double stdio_time = now() - start;
+
+	start = now();
+	for (size_t i = 0; i < LINES; i++) {
+		for (size_t j = 0; j < ITEMS_PER_LINE; j++) {
+			output_number(values[i * ITEMS_PER_LINE + j]);
+			if (j < ITEMS_PER_LINE - 1) output_zone();
+			else output_char('\n');
+		}
+	}
+	flush_output();
+	double buffered_time = now() - start;
+
+	start = now();
+	run_program(&program);
+	double program_time = now() - start;
+
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	close(null_fd);
+
+	printf("round trips:  %zu wrong of %zu (%zu of a sample of %zu not the shortest)\n", wrong, checked, longer, checked / 16);
+	printf("stdio %%g:     %8.3fs  %10.0f lines/s\n", stdio_time, LINES / stdio_time);
+	printf("buffered:     %8.3fs  %10.0f lines/s\n", buffered_time, LINES / buffered_time);
+	printf("speedup:      %8.2fx\n", stdio_time / buffered_time);
+	printf("print loop:   %8.3fs  %10.0f lines/s\n", program_time, PROGRAM_LINES / program_time);
+
+	free_program(program);
+	free(code.chars);
+	free(values);
+
+	return wrong == 0 && wrong_zones == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
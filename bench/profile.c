@@ -0,0 +1,110 @@
+// runs a few programs with and without the profiler to see what it costs,
+// and checks it counted every statement as many times as it really ran
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "profile.h"
+#include "utils.h"
+
+#define ITERATIONS 2000000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// runs a program with stdout sent to /dev/null, profiling it if profile isn't
+// NULL
+static double time_program(Program *program, Profile *profile) {
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+
+	active_profile = profile;
+	double start = now();
+	run_program(program);
+	double time = now() - start;
+	active_profile = NULL;
+
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	close(null_fd);
+
+	return time;
+}
+
+// every statement apart from the ones on the last line runs once per
+// iteration
+static size_t wrong_counts(Program *program, Profile *profile, uint32_t last_line) {
+	size_t wrong = 0;
+
+	for (size_t i = 0; i < program->statement_lines_length; i++) {
+		uint64_t expected = program->statement_lines[i].line == last_line ? 1 : ITERATIONS;
+		if (profile->statements[i].runs == expected) continue;
+
+		if (wrong++ < 5) {
+			printf(
+				"Error: statement on line %u ran %llu times, not %llu\n", program->statement_lines[i].line,
+				(unsigned long long)profile->statements[i].runs, (unsigned long long)expected
+			);
+		}
+	}
+
+	return wrong;
+}
+
+static size_t run(char *name, char *format, uint32_t last_line) {
+	char code[512];
+	snprintf(code, sizeof(code), format, ITERATIONS);
+
+	ParserResult parser_result = parse(code);
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+	Program program = compile_result.result.program;
+
+	double plain_time = time_program(&program, NULL);
+	Profile *profile = new_profile(&program);
+	double profiled_time = time_program(&program, profile);
+
+	size_t wrong = wrong_counts(&program, profile, last_line);
+	if (profile->depth != 0) {
+		printf("Error: %s finished %zu subroutines deep\n", name, profile->depth);
+		wrong++;
+	}
+
+	printf(
+		"%-10s plain %7.3fs   profiled %7.3fs   overhead %5.1f%%   %6llu samples\n", name,
+		plain_time, profiled_time, (profiled_time / plain_time - 1) * 100, (unsigned long long)profile->samples
+	);
+
+	free_profile(profile);
+	free_program(program);
+	return wrong;
+}
+
+int main(void) {
+	size_t wrong = 0;
+
+	wrong += run("loop", "10 let i = i + 1\nlet a = a + i * 2\nif i < %d then 10\nprint a\n", 4);
+	wrong += run(
+		"gosub", "10 let i = i + 1\ngosub 100\nif i < %d then 10\nend\n100 let a = a + i\nreturn\n", 4
+	);
+	wrong += run("strings", "10 let i = i + 1\nlet s$ = \"abc\"\nif s$ < \"b\" then let s$ = \"x\"\nif i < %d then 10\nprint s$\n", 5);
+
+	jit_mode = JIT_OFF;
+	wrong += run("no jit", "10 let i = i + 1\nlet a = a + i * 2\nif i < %d then 10\nprint a\n", 4);
+
+	printf("wrong counts: %zu\n", wrong);
+	return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+// checks the simd scanners give the same answers as the scalar one, then
+// compares how fast a comment heavy program lexes with each of them
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "scan.h"
+#include "utils.h"
+
+#define CHECK_BUFFERS 20000
+#define MAX_CHECK_LENGTH 200
+#define PROGRAM_LINES 200000
+#define ROUNDS 5
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static size_t check_scanner(const Scanner *candidate) {
+	// the chars each scanner cares about, plus some it should skip over
+	char alphabet[] = { ' ', ' ', ' ', '\t', '\r', '\n', '"', '\\', 'a', 'x', '\'' };
+	char *memory = aligned_alloc(64, MAX_CHECK_LENGTH + 128);
+	size_t mismatches = 0;
+
+	srand(2);
+	for (size_t n = 0; n < CHECK_BUFFERS; n++) {
+		// start the buffer at every alignment
+		char *buffer = memory + n % 64;
+		size_t length = rand() % MAX_CHECK_LENGTH;
+
+		for (size_t i = 0; i < length; i++)
+			buffer[i] = alphabet[rand() % sizeof(alphabet)];
+		buffer[length] = '\0';
+
+		for (size_t start = 0; start <= length; start++) {
+			mismatches += candidate->skip_whitespace(buffer, start) != scalar_scanner.skip_whitespace(buffer, start);
+			mismatches += candidate->find_line_end(buffer, start) != scalar_scanner.find_line_end(buffer, start);
+			mismatches += candidate->find_string_end(buffer, start) != scalar_scanner.find_string_end(buffer, start);
+		}
+	}
+
+	free(memory);
+	return mismatches;
+}
+
+static char *generate_program(size_t *length) {
+	size_t capacity = PROGRAM_LINES * 100;
+	char *code = malloc(capacity);
+	size_t used = 0;
+
+	srand(3);
+	for (size_t i = 0; i < PROGRAM_LINES; i++) {
+		if (i % 3 != 2)
+			used += sprintf(code + used, "    ' generated comment number %zu, describing what the next line does\n", i);
+		else
+			used += sprintf(code + used, "\tprint \"some output for line %zu\"; x, \"and more text\"\n", i);
+	}
+
+	*length = used;
+	return code;
+}
+
+static void bench_scanner(const Scanner *candidate, char *code, size_t length) {
+	const Scanner *saved = scanner;
+	SymbolTable symbols = new_symbol_table();
+	double start = now();
+
+	for (size_t round = 0; round < ROUNDS; round++) {
+		// new_lexer picks the best scanner, so swap this one in afterwards
+		Lexer *lexer = new_lexer(code, 3, &symbols);
+		scanner = candidate;
+		while (next_token(lexer).result.token.type != TOKEN_EOF);
+		free_lexer(lexer);
+	}
+
+	double time = now() - start;
+	free_symbol_table(&symbols);
+	scanner = saved;
+
+	printf("%-6s  %8.1f MB/s\n", candidate->name, length * ROUNDS / time / 1e6);
+}
+
+int main(void) {
+	size_t total_mismatches = 0;
+
+#ifdef HAVE_SIMD_SCANNERS
+	const Scanner *candidates[] = { &scalar_scanner, &sse2_scanner, &avx2_scanner };
+	size_t candidate_count = __builtin_cpu_supports("avx2") ? 3 : 2;
+#else
+	const Scanner *candidates[] = { &scalar_scanner };
+	size_t candidate_count = 1;
+#endif
+
+	for (size_t i = 1; i < candidate_count; i++) {
+		size_t mismatches = check_scanner(candidates[i]);
+		printf("%s differs from scalar %zu times\n", candidates[i]->name, mismatches);
+		total_mismatches += mismatches;
+	}
+
+	size_t length;
+	char *code = generate_program(&length);
+
+	for (size_t i = 0; i < candidate_count; i++)
+		bench_scanner(candidates[i], code, length);
+
+	free(code);
+
+	return total_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
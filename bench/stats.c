@@ -0,0 +1,100 @@
+// checks --stats counts the tokens it should, and sees what counting costs by
+// parsing and compiling the same program with the counters off and on
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+#include "compiler.h"
+#include "stats.h"
+
+#define LINES 200000
+#define ROUNDS 5
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// each line is "let a = a + 1" followed by a newline
+static char *make_program(void) {
+	char *line = "let a = a + 1\n";
+	size_t length = strlen(line);
+
+	char *code = malloc(length * LINES + 1);
+	for (size_t i = 0; i < LINES; i++) memcpy(code + i * length, line, length);
+	code[length * LINES] = '\0';
+
+	return code;
+}
+
+static double build(char *code) {
+	double start = now();
+
+	ParserResult parser_result = parse(code);
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+	free_program(compile_result.result.program);
+
+	return now() - start;
+}
+
+static size_t check(Stats *stats, TokenType type, uint64_t expected) {
+	if (stats->tokens[type] == expected) return 0;
+
+	printf(
+		"Error: counted %llu %s tokens, not %llu\n", (unsigned long long)stats->tokens[type],
+		stringify_token_type(type), (unsigned long long)expected
+	);
+	return 1;
+}
+
+int main(void) {
+	char *code = make_program();
+	double off_time = 1e9, on_time = 1e9;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		stats_enabled = false;
+		double time = build(code);
+		if (time < off_time) off_time = time;
+
+		reset_stats();
+		stats_enabled = true;
+		time = build(code);
+		if (time < on_time) on_time = time;
+	}
+
+	Stats stats = read_stats();
+	size_t wrong = 0;
+
+	wrong += check(&stats, TOKEN_LET, LINES);
+	wrong += check(&stats, TOKEN_NAME, LINES * 2);
+	wrong += check(&stats, TOKEN_ASSIGN, LINES);
+	wrong += check(&stats, TOKEN_BINARY_OP, LINES);
+	wrong += check(&stats, TOKEN_NUMBER, LINES);
+	wrong += check(&stats, TOKEN_NEWLINE, LINES);
+	wrong += check(&stats, TOKEN_EOF, 1);
+
+	// the parser only allocates for errors and parsing in parallel, and nothing
+	// was run
+	for (StatsSubsystem subsystem = 0; subsystem < STATS_SUBSYSTEMS; subsystem++) {
+		if (subsystem == STATS_PARSER || subsystem == STATS_RUNTIME) continue;
+		if (stats.allocations[subsystem] > 0) continue;
+		printf("Error: nothing was counted for the %s\n", stringify_subsystem(subsystem));
+		wrong++;
+	}
+
+	printf(
+		"%d lines   off %7.3fs   on %7.3fs overhead %5.1f%%\n", LINES,
+		off_time, on_time, (on_time / off_time - 1) * 100
+	);
+
+	print_stats(stdout, &stats);
+	free(code);
+
+	printf("wrong counts: %zu\n", wrong);
+	return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+// compares building a string by appending to it with a StringBuilder against
+// the old way (finding the end with strlen and reallocating to the exact size
+// every time), then times a BASIC loop that does the same with s$ = s$ + "x"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "utils.h"
+
+#define APPENDS 1000000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static char *pieces[] = { "x", "ab", "let", ")\n", " * ", "v" };
+#define PIECES (sizeof(pieces) / sizeof(*pieces))
+
+// how append_str used to work
+static void naive_append(char **dest, char *src) {
+	*dest = realloc(*dest, strlen(*dest) + strlen(src) + 1);
+	ensure_alloc(*dest);
+	strcat(*dest, src);
+}
+
+static double time_naive(size_t appends, char **result) {
+	double start = now();
+	char *string = malloc(1);
+	ensure_alloc(string);
+	string[0] = '\0';
+
+	for (size_t i = 0; i < appends; i++) naive_append(&string, pieces[i % PIECES]);
+
+	*result = string;
+	return now() - start;
+}
+
+static double time_builder(size_t appends, char **result) {
+	double start = now();
+	StringBuilder builder = new_string_builder(16);
+
+	for (size_t i = 0; i < appends; i++) builder_append_str(&builder, pieces[i % PIECES]);
+
+	*result = builder.chars;
+	return now() - start;
+}
+
+// runs a program with stdout sent to /dev/null
+static double time_program(char *code) {
+	ParserResult parser_result = parse(code);
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+	Program program = compile_result.result.program;
+
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+
+	double start = now();
+	run_program(&program);
+	double time = now() - start;
+
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	close(null_fd);
+	free_program(program);
+
+	return time;
+}
+
+int main(void) {
+	size_t mismatches = 0;
+
+	// the naive version is quadratic, so it only gets as far as it can in a
+	// reasonable time
+	for (size_t appends = 25000; appends <= 100000; appends *= 2) {
+		char *naive, *built;
+		double naive_time = time_naive(appends, &naive);
+		double builder_time = time_builder(appends, &built);
+		mismatches += strcmp(naive, built) != 0;
+
+		printf("%7zu appends:   strlen+realloc %8.3fs   builder %8.4fs\n", appends, naive_time, builder_time);
+		free(naive);
+		free(built);
+	}
+
+	char *built;
+	double builder_time = time_builder(APPENDS, &built);
+	printf("%7d appends:   builder %8.4fs  %10.0f appends/s\n", APPENDS, builder_time, APPENDS / builder_time);
+	free(built);
+
+	char code[256];
+
+	// s$ is moved onto the stack and grown in place
+	snprintf(code, sizeof(code), "10 let s$ = s$ + \"x\"\nlet i = i + 1\nif i < %d then 10\nprint s$\n", APPENDS);
+	double append_time = time_program(code);
+	printf("s$ = s$ + \"x\":  %8.3fs  %10.0f appends/s  (%d appends)\n", append_time, APPENDS / append_time, APPENDS);
+
+	// going through another variable means there's always a second reference,
+	// so every join has to copy and it's quadratic again
+	snprintf(code, sizeof(code), "10 let t$ = s$ + \"x\"\nlet s$ = t$\nlet i = i + 1\nif i < %d then 10\nprint s$\n", APPENDS / 20);
+	double copy_time = time_program(code);
+	printf("t$ = s$ + \"x\":  %8.3fs  %10.0f appends/s  (%d appends)\n", copy_time, APPENDS / 20 / copy_time, APPENDS / 20);
+
+	printf("mismatches:     %zu\n", mismatches);
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,139 @@
+// checks that string values keep their chars and compare the same way strcmp
+// does, then runs a program that does little but shuffle, compare and print
+// strings, and reports how much memory its values take up
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "value.h"
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "utils.h"
+
+#define CHECK_STRINGS 1000000
+#define VARIABLES 20
+#define STATEMENTS 60
+#define ITERATIONS 200000
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static int sign(int number) {
+	return (number > 0) - (number < 0);
+}
+
+// mostly short strings from a small alphabet so plenty of them share prefixes
+static size_t random_string(char *buffer) {
+	size_t length = rand() % 3 == 0 ? rand() % 20 : rand() % (SHORT_STRING_MAX + 1);
+	for (size_t i = 0; i < length; i++) buffer[i] = "abc~\x7f\x80\xff"[rand() % 7];
+	buffer[length] = '\0';
+	return length;
+}
+
+static char *generate_program(bool print) {
+	static char *words[] = {
+		"a", "ok", "dog", "blue", "hello", "purple", "strings!",
+		"a much longer string than six", "zebra crossing", "x"
+	};
+
+	StringBuilder code = new_string_builder(4096);
+	char line[128];
+
+	srand(5);
+	builder_append_str(&code, "10 let i = i + 1\n");
+
+	for (size_t i = 0; i < STATEMENTS; i++) {
+		char a = 'a' + rand() % VARIABLES, b = 'a' + rand() % VARIABLES;
+		int kind = rand() % 20;
+
+		if (kind < 6) snprintf(line, sizeof(line), "let s%c$ = \"%s\"\n", a, words[rand() % 10]);
+		else if (kind < 14) snprintf(line, sizeof(line), "let s%c$ = s%c$\n", a, b);
+		else if (kind < 17 || !print) snprintf(line, sizeof(line), "if s%c$ < s%c$ then let n = n + 1\n", a, b);
+		else snprintf(line, sizeof(line), "print s%c$; \" \"; s%c$, n\n", a, b);
+
+		builder_append_str(&code, line);
+	}
+
+	snprintf(line, sizeof(line), "if i < %d then 10\n", ITERATIONS);
+	builder_append_str(&code, line);
+
+	return code.chars;
+}
+
+static void run_generated(bool print) {
+	char *code = generate_program(print);
+	ParserResult parser_result = parse(code);
+	CompileResult compile_result = compile(parser_result.result.ast);
+	free_ast(parser_result.result.ast);
+	Program program = compile_result.result.program;
+
+	size_t inline_strings = 0, heap_bytes = 0;
+	for (size_t i = 0; i < program.strings_length; i++) {
+		size_t length = strlen(program.strings[i]);
+		if (length <= SHORT_STRING_MAX) inline_strings++;
+		else heap_bytes += sizeof(HeapString) + length + 1;
+	}
+
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+
+	double start = now();
+	run_program(&program);
+	double time = now() - start;
+
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	close(null_fd);
+
+	double statements = (double)(STATEMENTS + 2) * ITERATIONS;
+	printf("%s\n", print ? "with print:" : "without print:");
+	printf("  time:       %8.3fs  %10.0f statements/s\n", time, statements / time);
+	printf("  variables:  %zu bytes, stack %zu bytes\n",
+		sizeof(Value) * program.variables_length, sizeof(Value) * (program.max_stack_depth + 1));
+	printf("  constants:  %zu of %zu strings inline, %zu bytes on the heap\n",
+		inline_strings, program.strings_length, heap_bytes);
+
+	free_program(program);
+	free(code);
+}
+
+int main(void) {
+	char a[32], b[32], buffer[SHORT_STRING_MAX];
+	size_t wrong = 0;
+
+	srand(6);
+	for (size_t i = 0; i < CHECK_STRINGS; i++) {
+		size_t a_length = random_string(a), b_length = random_string(b);
+		Value a_value = string_value(a, a_length);
+		Value b_value = i % 2 ? constant_string_value(b, b_length) : string_value(b, b_length);
+
+		StringSlice chars = value_string(a_value, buffer);
+		bool same = chars.length == a_length && memcmp(chars.chars, a, a_length) == 0;
+
+		if (!same || sign(compare_strings(a_value, b_value)) != sign(strcmp(a, b))) {
+			if (wrong++ < 5) printf("Error: \"%s\" and \"%s\" came out wrong\n", a, b);
+		}
+
+		release_value(a_value);
+		if (i % 2) free_constant_string(b_value);
+		else release_value(b_value);
+	}
+
+	printf("strings:      %zu wrong of %d\n", wrong, CHECK_STRINGS);
+	printf("value size:   %zu bytes\n", sizeof(Value));
+
+	run_generated(false);
+	run_generated(true);
+
+	return wrong == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+// compares the bytecode vm against a tree-walking evaluator on a generated
+// straight-line program, after checking PRINT needs , or ; between its items
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "builtins.h"
+#include "utils.h"
+
+#define VARIABLES 26
+#define STATEMENTS 2000
+#define RUNS 500
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static char *generate_program(void) {
+	StringBuilder code = new_string_builder(4096);
+	char line[256];
+
+	srand(1);
+
+	for (size_t i = 0; i < STATEMENTS; i++) {
+		// names can't contain digits so use a single letter after the v
+		char a = 'a' + rand() % VARIABLES, b = 'a' + rand() % VARIABLES, c = 'a' + rand() % VARIABLES;
+		snprintf(
+			line, sizeof(line), "let v%c = (v%c + %d.5) * abs(v%c - %d) / (%d + v%c * v%c) - -v%c\n",
+			'a' + rand() % VARIABLES, a, rand() % 9 + 1, b, rand() % 9 + 1, rand() % 9 + 1, c, c, a
+		);
+		builder_append_str(&code, line);
+	}
+
+	return code.chars;
+}
+
+// the tree walker keeps variables in slots indexed by their symbols, the same
+// as the vm does, so the only difference between them is how they're run
+
+static double evaluate(double *variables, ExprPool *pool, ExprIndex expr) {
+	switch (pool->kinds[expr]) {
+		case EXPR_NUMBER: return pool->values[expr].number;
+		case EXPR_VAR: return variables[pool->values[expr].variable];
+		case EXPR_NEGATE: return -evaluate(variables, pool, expr - 1);
+		case EXPR_BUILTIN:
+			return builtins[pool->ops[expr]].function(evaluate(variables, pool, expr - 1));
+		case EXPR_BINARY: {
+			double lhs = evaluate(variables, pool, pool->values[expr].lhs);
+			double rhs = evaluate(variables, pool, expr - 1);
+
+			switch (pool->ops[expr]) {
+				case '+': return lhs + rhs;
+				case '-': return lhs - rhs;
+				case '*': return lhs * rhs;
+				case '/': return lhs / rhs;
+				case '^': return pow(lhs, rhs);
+				default: return 0;
+			}
+		}
+		default: return 0;
+	}
+}
+
+// every item after the first has to come after a , or ;, or it'd be lost
+static bool check_print_delimiters(void) {
+	static char *rejected[] = { "print \"A\" 1\n", "print \"a\" \"b\"\n", "print 1; 2 3\n" };
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+		ParserResult result = parse(rejected[i]);
+
+		if (result.success) {
+			printf("Error: %.*s parsed without a delimiter\n", (int)strlen(rejected[i]) - 1, rejected[i]);
+			free_ast(result.result.ast);
+			ok = false;
+		} else {
+			free_error_list(result.result.errors);
+		}
+	}
+
+	return ok;
+}
+
+int main(void) {
+	if (!check_print_delimiters()) return EXIT_FAILURE;
+
+	char *code = generate_program();
+	ParserResult parser_result = parse(code);
+
+	if (!parser_result.success) {
+		printf("Error: generated program didn't parse\n");
+		return EXIT_FAILURE;
+	}
+
+	AST ast = parser_result.result.ast;
+
+	double *variables = malloc(sizeof(double) * ast.symbols.length);
+	ensure_alloc(variables);
+
+	double start = now();
+	for (size_t run = 0; run < RUNS; run++) {
+		for (size_t i = 0; i < ast.symbols.length; i++) variables[i] = 0;
+
+		for (size_t i = 0; i < ast.length; i++) {
+			Statement statement = ast.statements[i];
+			variables[statement.statement.assignment.variable] = evaluate(variables, &ast.exprs, statement.statement.assignment.expr);
+		}
+	}
+	double tree_time = now() - start;
+	free(variables);
+
+	Program program = compile(ast).result.program;
+
+	// only the bytecode is being measured, not machine code
+	jit_mode = JIT_OFF;
+
+	start = now();
+	for (size_t run = 0; run < RUNS; run++)
+		run_program(&program);
+	double vm_time = now() - start;
+
+	size_t statements = STATEMENTS * RUNS;
+	printf("tree walker: %8.3fs  %10.0f statements/s\n", tree_time, statements / tree_time);
+	printf("bytecode vm: %8.3fs  %10.0f statements/s\n", vm_time, statements / vm_time);
+	printf("speedup:     %8.2fx\n", tree_time / vm_time);
+
+	free_program(program);
+	free_ast(ast);
+	free(code);
+
+	return EXIT_SUCCESS;
+}
@@ -1 +1,3 @@
-(1 + ABS(-2) * -(x - -2.5^3^-4 - $)) / -$th_ing + F(((1)), 6.5 + .5 * 4 - -.030); "test", (x)
+let x = 3
+let th_ing = 2
+print (1 + ABS(-2) * -(x - -2.5^3^-4 - x)) / -th_ing + INT(((1)) + 6.5 + .5 * 4 - -.030); "test", (x)
@@ -0,0 +1,11 @@
+10 let n = 1
+20 gosub 1000
+let n = n + 1
+if n <= 5 then 20
+if n > 5 then print "done"
+end
+
+' squares n and prints it. line numbers don't need to be in order or close
+' together
+1000 print n; " squared is "; n ^ 2
+return
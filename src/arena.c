@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+#include "stats.h"
+
+#define ALIGNMENT _Alignof(max_align_t)
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+Arena new_arena(size_t chunk_size) {
+	return (Arena){ .chunks = NULL, .chunk_size = chunk_size, .last_allocation = NULL };
+}
+
+void free_arena(Arena *arena) {
+	ArenaChunk *chunk = arena->chunks;
+
+	while (chunk != NULL) {
+		ArenaChunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	arena->chunks = NULL;
+	arena->last_allocation = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+	size = ALIGN_UP(size);
+	ArenaChunk *chunk = arena->chunks;
+
+	if (chunk == NULL || chunk->capacity - chunk->used < size) {
+		// anything bigger than a chunk gets a chunk of its own
+		size_t capacity = size > arena->chunk_size ? size : arena->chunk_size;
+
+		chunk = malloc(sizeof(ArenaChunk) + capacity);
+		ensure_alloc(chunk);
+		count_alloc(STATS_AST, sizeof(ArenaChunk) + capacity);
+
+		chunk->next = arena->chunks;
+		chunk->capacity = capacity;
+		chunk->used = 0;
+		arena->chunks = chunk;
+	}
+
+	void *ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->last_allocation = ptr;
+
+	return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+	if (ptr == NULL) return arena_alloc(arena, new_size);
+
+	// the most recent allocation can just be extended if there's room for it
+	ArenaChunk *chunk = arena->chunks;
+	if (ptr == arena->last_allocation) {
+		size_t offset = (char *)ptr - chunk->data;
+		if (ALIGN_UP(new_size) <= chunk->capacity - offset) {
+			chunk->used = offset + ALIGN_UP(new_size);
+			return ptr;
+		}
+	}
+
+	void *new_ptr = arena_alloc(arena, new_size);
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+
+	return new_ptr;
+}
+
+char *arena_strndup(Arena *arena, char *string, size_t length) {
+	char *copy = arena_alloc(arena, length + 1);
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+void arena_adopt(Arena *arena, Arena *other) {
+	if (other->chunks == NULL) return;
+
+	ArenaChunk *last = other->chunks;
+	while (last->next != NULL) last = last->next;
+
+	// the adopted chunks go after the current one so allocation carries on
+	// from where it was
+	if (arena->chunks == NULL) {
+		arena->chunks = other->chunks;
+		arena->last_allocation = NULL;
+	} else {
+		last->next = arena->chunks->next;
+		arena->chunks->next = other->chunks;
+	}
+
+	other->chunks = NULL;
+	other->last_allocation = NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_ARENA_H
+#define INCLUDE_ARENA_H
+
+#include <stddef.h>
+
+// a bump allocator which hands out memory from a chain of chunks. nothing
+// is freed individually; everything goes at once when the arena is freed
+
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t capacity;
+	size_t used;
+	char data[];
+} ArenaChunk;
+
+typedef struct {
+	ArenaChunk *chunks; // most recent chunk first
+	size_t chunk_size;
+	void *last_allocation; // so that it can be grown in place
+} Arena;
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+extern Arena new_arena(size_t chunk_size);
+extern void free_arena(Arena *arena);
+
+extern void *arena_alloc(Arena *arena, size_t size);
+extern void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+extern char *arena_strndup(Arena *arena, char *string, size_t length);
+
+// moves all of other's memory into arena, leaving other empty
+extern void arena_adopt(Arena *arena, Arena *other);
+
+#endif  // INCLUDE_ARENA_H
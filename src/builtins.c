@@ -0,0 +1,35 @@
+#include <math.h>
+#include <strings.h>
+
+#include "builtins.h"
+
+static double builtin_int(double x) { return floor(x); }
+
+static double builtin_sgn(double x) {
+	if (x > 0) return 1;
+	if (x < 0) return -1;
+	return 0;
+}
+
+Builtin builtins[] = {
+	{ "abs", 1, fabs },
+	{ "atn", 1, atan },
+	{ "cos", 1, cos },
+	{ "exp", 1, exp },
+	{ "int", 1, builtin_int },
+	{ "log", 1, log },
+	{ "sgn", 1, builtin_sgn },
+	{ "sin", 1, sin },
+	{ "sqr", 1, sqrt },
+	{ "tan", 1, tan }
+};
+
+size_t builtin_count = sizeof(builtins) / sizeof(Builtin);
+
+int find_builtin(char *name) {
+	for (size_t i = 0; i < builtin_count; i++)
+		if (strcasecmp(builtins[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
@@ -0,0 +1,20 @@
+#ifndef INCLUDE_BUILTINS_H
+#define INCLUDE_BUILTINS_H
+
+#include <stddef.h>
+
+typedef double (*BuiltinFunction)(double);
+
+typedef struct {
+	char *name;
+	size_t arity;
+	BuiltinFunction function;
+} Builtin;
+
+extern Builtin builtins[];
+extern size_t builtin_count;
+
+// returns the index of the builtin called name (ignoring case) or -1
+extern int find_builtin(char *name);
+
+#endif  // INCLUDE_BUILTINS_H
@@ -0,0 +1,463 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "utils.h"
+#include "value.h"
+#include "builtins.h"
+
+// a cache file is the header followed by the sections it points to. every
+// position in it is an offset from the start of the file, so it can be mapped
+// anywhere and used as it is. the strings and variables sections are tables of
+// offsets to null terminated strings further on in the file
+
+#define CACHE_MAGIC "BASC"
+#define BYTE_ORDER_MARK 0x01020304
+
+typedef struct {
+	uint64_t offset;
+	uint64_t length; // in elements, not bytes
+} CacheSection;
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t instruction_size;
+	SourceKey source;
+	uint64_t max_stack_depth;
+	CacheSection code, numbers, strings, variables, statement_lines;
+} CacheHeader;
+
+char *cache_path(char *source_path) {
+	size_t length = strlen(source_path);
+	char *path = malloc(length + 2);
+	ensure_alloc(path);
+	memcpy(path, source_path, length);
+	path[length] = 'c';
+	path[length + 1] = '\0';
+	return path;
+}
+
+// the primes from xxh64
+#define PRIME_1 11400714785074694791ULL
+#define PRIME_2 14029467366897019727ULL
+#define PRIME_3 1609587929392839161ULL
+#define PRIME_4 9650029242287828579ULL
+#define PRIME_5 2870177450012600261ULL
+
+static inline uint64_t rotate_left(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+// an xxh64 round. multiplying only carries upwards, so the rotate is what
+// lets the top bytes of a word change the bottom of the lane
+static inline uint64_t mix_word(uint64_t lane, uint64_t word) {
+	lane += word * PRIME_2;
+	return rotate_left(lane, 31) * PRIME_1;
+}
+
+// the xxh64 avalanche, so every bit of the lane reaches every bit of the result
+static inline uint64_t finish_lane(uint64_t lane) {
+	lane ^= lane >> 33;
+	lane *= PRIME_2;
+	lane ^= lane >> 29;
+	lane *= PRIME_3;
+	return lane ^ (lane >> 32);
+}
+
+// four lanes go through the source a stripe of 32 bytes at a time, like xxh64,
+// so their multiplies can overlap. it has to get through the whole source
+// before the cache can be used, so it needs to be quick
+SourceKey source_key(SourceFile *source) {
+	char *code = source->code;
+	size_t length = source->length;
+	uint64_t lanes[4] = { PRIME_1 + PRIME_2, PRIME_2, 0, -PRIME_1 };
+	size_t i = 0;
+
+	for (; i + 32 <= length; i += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t word;
+			memcpy(&word, code + i + lane * 8, 8);
+			lanes[lane] = mix_word(lanes[lane], word);
+		}
+	}
+
+	// merging the lanes in two different orders gives the two halves of the
+	// hash, which then both take in whatever's left over
+	uint64_t low = PRIME_5, high = PRIME_1;
+	for (int lane = 0; lane < 4; lane++) {
+		low = (low ^ mix_word(0, lanes[lane])) * PRIME_1 + PRIME_4;
+		high = (high ^ mix_word(0, rotate_left(lanes[3 - lane], 32))) * PRIME_1 + PRIME_4;
+	}
+
+	// the last word is padded with zeros, and the length goes in at the end so
+	// the padding can't be confused with zeros in the source
+	while (i < length) {
+		uint64_t word = 0;
+		size_t size = length - i < 8 ? length - i : 8;
+		memcpy(&word, code + i, size);
+		low = mix_word(low, word);
+		high = mix_word(high, rotate_left(word, 32));
+		i += size;
+	}
+
+	low = finish_lane(low ^ length);
+	high = finish_lane(high ^ length ^ low);
+
+	return (SourceKey){
+		{ low, high }, length,
+		source->modified.tv_sec, source->modified.tv_nsec
+	};
+}
+
+static bool section_fits(CacheSection section, size_t element_size, size_t file_length) {
+	return section.offset <= file_length && section.length <= (file_length - section.offset) / element_size;
+}
+
+// turns a table of offsets into the file into an array of pointers, checking
+// that every string really is in the file
+static char **map_strings(char *base, size_t file_length, CacheSection section) {
+	uint64_t *offsets = (uint64_t *)(base + section.offset);
+	char **strings = malloc(sizeof(char *) * (section.length + 1));
+	ensure_alloc(strings);
+
+	for (size_t i = 0; i < section.length; i++) {
+		if (offsets[i] >= file_length || memchr(base + offsets[i], '\0', file_length - offsets[i]) == NULL) {
+			free(strings);
+			return NULL;
+		}
+
+		strings[i] = base + offsets[i];
+	}
+
+	return strings;
+}
+
+// what the stack holds while a program is checked. it's empty between
+// statements, which is the only place jumps go from or to, so following the
+// code from start to end sees exactly what the vm would
+typedef struct {
+	bool *is_string;
+	size_t depth, max_depth;
+	uint8_t *variables; // VARIABLE_NUMBER or VARIABLE_STRING for each slot
+} CheckStack;
+
+#define VARIABLE_NUMBER 1
+#define VARIABLE_STRING 2
+
+static bool push_slot(CheckStack *stack, bool is_string) {
+	if (stack->depth == stack->max_depth) return false;
+	stack->is_string[stack->depth++] = is_string;
+	return true;
+}
+
+static bool pop_slot(CheckStack *stack, bool is_string) {
+	return stack->depth > 0 && stack->is_string[--stack->depth] == is_string;
+}
+
+static bool check_instruction(Program *program, Instruction instruction, CheckStack *stack) {
+	uint32_t operand = instruction.operand;
+
+	switch (instruction.opcode) {
+		case OP_PUSH_NUMBER: return operand < program->numbers_length && push_slot(stack, false);
+		case OP_PUSH_STRING: return operand < program->strings_length && push_slot(stack, true);
+		case OP_LOAD_VAR:
+			return operand < program->variables_length && stack->variables[operand] == VARIABLE_NUMBER && push_slot(stack, false);
+		case OP_STORE_VAR:
+			return operand < program->variables_length && stack->variables[operand] == VARIABLE_NUMBER && pop_slot(stack, false);
+		case OP_LOAD_STRING_VAR:
+		case OP_TAKE_STRING_VAR:
+			return operand < program->variables_length && stack->variables[operand] == VARIABLE_STRING && push_slot(stack, true);
+		case OP_STORE_STRING_VAR:
+			return operand < program->variables_length && stack->variables[operand] == VARIABLE_STRING && pop_slot(stack, true);
+		case OP_ADD:
+		case OP_SUBTRACT:
+		case OP_MULTIPLY:
+		case OP_DIVIDE:
+		case OP_POWER: return pop_slot(stack, false) && pop_slot(stack, false) && push_slot(stack, false);
+		case OP_EQUAL:
+		case OP_NOT_EQUAL:
+		case OP_LESS:
+		case OP_LESS_EQUAL:
+		case OP_GREATER:
+		case OP_GREATER_EQUAL: {
+			// either two numbers or two strings
+			if (stack->depth < 2) return false;
+			bool is_string = stack->is_string[stack->depth - 1];
+			return pop_slot(stack, is_string) && pop_slot(stack, is_string) && push_slot(stack, false);
+		}
+		case OP_NEGATE: return pop_slot(stack, false) && push_slot(stack, false);
+		case OP_CONCAT: return pop_slot(stack, true) && pop_slot(stack, true) && push_slot(stack, true);
+		case OP_CALL_BUILTIN:
+			if (operand >= builtin_count) return false;
+			for (size_t i = 0; i < builtins[operand].arity; i++)
+				if (!pop_slot(stack, false)) return false;
+			return push_slot(stack, false);
+		case OP_PRINT:
+			if (stack->depth == 0) return false;
+			stack->depth--;
+			return true;
+		case OP_PRINT_ZONE:
+		case OP_PRINT_NEWLINE:
+		case OP_HALT: return true;
+		case OP_JUMP:
+		case OP_GOSUB: return operand < program->length && stack->depth == 0;
+		case OP_JUMP_IF_FALSE:
+		case OP_JUMP_IF_TRUE: return operand < program->length && pop_slot(stack, false) && stack->depth == 0;
+		case OP_RETURN: return stack->depth == 0;
+		default: return false; // including the jit and profiler entries, which are never compiled
+	}
+}
+
+// a cache file that's been cut short or corrupted can still get past the
+// header, so everything the vm indexes with is checked before it's trusted,
+// along with what each instruction finds on the stack
+static bool program_is_valid(Program *program) {
+	size_t length = program->length;
+	if (length == 0 || program->max_stack_depth > length) return false;
+
+	// a number that looks like a string would be taken for a pointer
+	for (size_t i = 0; i < program->numbers_length; i++)
+		if (value_is_string(number_value(program->numbers[i]))) return false;
+
+	for (size_t i = 0; i < program->statement_lines_length; i++) {
+		uint32_t offset = program->statement_lines[i].offset;
+		if (offset >= length || (i > 0 && offset < program->statement_lines[i - 1].offset)) return false;
+	}
+
+	// nothing can run off the end of the code
+	uint8_t last = program->code[length - 1].opcode;
+	if (last != OP_HALT && last != OP_JUMP && last != OP_RETURN) return false;
+
+	CheckStack stack = {
+		malloc(program->max_stack_depth + 1), 0, program->max_stack_depth,
+		malloc(program->variables_length + 1)
+	};
+	bool *empty = malloc(length); // whether the stack is empty before each instruction
+	ensure_alloc(stack.is_string);
+	ensure_alloc(stack.variables);
+	ensure_alloc(empty);
+	bool valid = true;
+
+	// string variables are the ones whose names end in $
+	for (size_t i = 0; i < program->variables_length; i++) {
+		size_t name_length = strlen(program->variables[i]);
+		bool is_string = name_length > 0 && program->variables[i][name_length - 1] == '$';
+		stack.variables[i] = is_string ? VARIABLE_STRING : VARIABLE_NUMBER;
+	}
+
+	for (size_t i = 0; i < length && valid; i++) {
+		empty[i] = stack.depth == 0;
+		valid = check_instruction(program, program->code[i], &stack);
+	}
+
+	// jumps have to land between statements too
+	for (size_t i = 0; i < length && valid; i++) {
+		uint8_t opcode = program->code[i].opcode;
+		if (opcode == OP_JUMP || opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE || opcode == OP_GOSUB)
+			valid = empty[program->code[i].operand];
+	}
+
+	free(stack.is_string);
+	free(stack.variables);
+	free(empty);
+	return valid;
+}
+
+CacheStatus load_cached_program(char *path, SourceKey *key, Program *program, size_t *bytes) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return CACHE_MISS;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0 || (size_t)file_stat.st_size < sizeof(CacheHeader)) {
+		close(fd);
+		return CACHE_MISS;
+	}
+
+	size_t length = file_stat.st_size;
+	char *base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED) return CACHE_MISS;
+
+	CacheHeader *header = (CacheHeader *)base;
+
+	if (
+		memcmp(header->magic, CACHE_MAGIC, 4) != 0 ||
+		header->version != CACHE_VERSION ||
+		header->byte_order != BYTE_ORDER_MARK ||
+		header->instruction_size != sizeof(Instruction) ||
+		header->source.length != key->length ||
+		header->source.modified_seconds != key->modified_seconds ||
+		header->source.modified_nanoseconds != key->modified_nanoseconds ||
+		header->source.hash[0] != key->hash[0] ||
+		header->source.hash[1] != key->hash[1] ||
+		!section_fits(header->code, sizeof(Instruction), length) ||
+		!section_fits(header->numbers, sizeof(double), length) ||
+		!section_fits(header->strings, sizeof(uint64_t), length) ||
+		!section_fits(header->variables, sizeof(uint64_t), length) ||
+		!section_fits(header->statement_lines, sizeof(StatementLine), length)
+	) {
+		munmap(base, length);
+		return CACHE_STALE;
+	}
+
+	char **strings = map_strings(base, length, header->strings);
+	char **variables = map_strings(base, length, header->variables);
+
+	if (strings == NULL || variables == NULL) {
+		free(strings);
+		free(variables);
+		munmap(base, length);
+		return CACHE_STALE;
+	}
+
+	Program mapped = (Program){
+		.code = (Instruction *)(base + header->code.offset),
+		.length = header->code.length,
+		.numbers = (double *)(base + header->numbers.offset),
+		.numbers_length = header->numbers.length,
+		.strings = strings,
+		.strings_length = header->strings.length,
+		.variables = variables,
+		.variables_length = header->variables.length,
+		.max_stack_depth = header->max_stack_depth,
+		.statement_lines = (StatementLine *)(base + header->statement_lines.offset),
+		.statement_lines_length = header->statement_lines.length,
+		.mapping = base,
+		.mapping_length = length
+	};
+
+	if (!program_is_valid(&mapped)) {
+		free(strings);
+		free(variables);
+		munmap(base, length);
+		return CACHE_STALE;
+	}
+
+	*program = mapped;
+	*bytes = length;
+
+	return CACHE_HIT;
+}
+
+// the file is built up in memory first, with every section 8 byte aligned
+typedef struct {
+	char *data;
+	size_t length, capacity;
+} CacheBuffer;
+
+static size_t reserve(CacheBuffer *buffer, size_t size) {
+	size_t offset = (buffer->length + 7) & ~(size_t)7;
+
+	if (offset + size > buffer->capacity) {
+		while (offset + size > buffer->capacity) buffer->capacity *= 2;
+		buffer->data = realloc(buffer->data, buffer->capacity);
+		ensure_alloc(buffer->data);
+	}
+
+	memset(buffer->data + buffer->length, 0, offset + size - buffer->length);
+	buffer->length = offset + size;
+
+	return offset;
+}
+
+static CacheSection write_section(CacheBuffer *buffer, void *elements, size_t length, size_t element_size) {
+	size_t offset = reserve(buffer, length * element_size);
+	if (length > 0) memcpy(buffer->data + offset, elements, length * element_size);
+	return (CacheSection){ offset, length };
+}
+
+static CacheSection write_strings(CacheBuffer *buffer, char **strings, size_t length) {
+	size_t table = reserve(buffer, length * sizeof(uint64_t));
+
+	for (size_t i = 0; i < length; i++) {
+		size_t string_length = strlen(strings[i]) + 1;
+		uint64_t offset = reserve(buffer, string_length);
+		memcpy(buffer->data + offset, strings[i], string_length);
+		memcpy(buffer->data + table + i * sizeof(uint64_t), &offset, sizeof(uint64_t));
+	}
+
+	return (CacheSection){ table, length };
+}
+
+size_t write_cached_program(char *path, SourceKey *key, Program *program) {
+	CacheBuffer buffer = { malloc(4096), 0, 4096 };
+	ensure_alloc(buffer.data);
+
+	reserve(&buffer, sizeof(CacheHeader));
+
+	CacheHeader header = {
+		.version = CACHE_VERSION,
+		.byte_order = BYTE_ORDER_MARK,
+		.instruction_size = sizeof(Instruction),
+		.source = *key,
+		.max_stack_depth = program->max_stack_depth
+	};
+	memcpy(header.magic, CACHE_MAGIC, 4);
+
+	header.code = write_section(&buffer, program->code, program->length, sizeof(Instruction));
+	header.numbers = write_section(&buffer, program->numbers, program->numbers_length, sizeof(double));
+	header.strings = write_strings(&buffer, program->strings, program->strings_length);
+	header.variables = write_strings(&buffer, program->variables, program->variables_length);
+	header.statement_lines = write_section(
+		&buffer, program->statement_lines, program->statement_lines_length, sizeof(StatementLine)
+	);
+	memcpy(buffer.data, &header, sizeof(CacheHeader));
+
+	char *temp_path = malloc(strlen(path) + 32);
+	ensure_alloc(temp_path);
+	sprintf(temp_path, "%s.%ld.tmp", path, (long)getpid());
+
+	int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	size_t written = 0;
+
+	if (fd >= 0) {
+		while (written < buffer.length) {
+			ssize_t result = write(fd, buffer.data + written, buffer.length - written);
+			if (result <= 0) break;
+			written += result;
+		}
+
+		close(fd);
+
+		if (written < buffer.length || rename(temp_path, path) < 0) {
+			unlink(temp_path);
+			written = 0;
+		}
+	}
+
+	free(temp_path);
+	free(buffer.data);
+
+	return written;
+}
+
+void print_cache_stats(CacheStats *stats) {
+	static const char *status_names[] = { "disabled", "hit", "miss", "stale" };
+
+	fprintf(stderr, "cache: %s", status_names[stats->status]);
+	if (stats->path != NULL) fprintf(stderr, " (%s)", stats->path);
+	fprintf(stderr, "\n");
+
+	if (stats->status == CACHE_DISABLED) return;
+
+	fprintf(stderr, "  hashing source:  %.3f ms\n", stats->hash_seconds * 1e3);
+
+	if (stats->status == CACHE_HIT) {
+		fprintf(stderr, "  loading cache:   %.3f ms (%zu bytes)\n", stats->load_seconds * 1e3, stats->bytes);
+		return;
+	}
+
+	fprintf(stderr, "  parse + compile: %.3f ms\n", stats->compile_seconds * 1e3);
+	if (stats->written)
+		fprintf(stderr, "  writing cache:   %.3f ms (%zu bytes)\n", stats->write_seconds * 1e3, stats->bytes);
+	else
+		fprintf(stderr, "  writing cache:   failed\n");
+}
@@ -0,0 +1,63 @@
+#ifndef INCLUDE_CACHE_H
+#define INCLUDE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "utils.h"
+
+// compiled programs are cached next to their source (file.bas goes in
+// file.basc) so running the same file again can skip parsing and compiling.
+// a cache file is only used if it was made from exactly the same source by
+// the same version of the interpreter, so it never needs clearing by hand
+
+// bump this whenever the bytecode or the cache layout changes
+#define CACHE_VERSION 6
+
+// what a cache file has to have been made from to be used. the size and
+// modification time are checked first, but the hash is what makes sure the
+// source really is the same
+typedef struct {
+	uint64_t hash[2];
+	uint64_t length;
+	int64_t modified_seconds;
+	int64_t modified_nanoseconds;
+} SourceKey;
+
+typedef enum {
+	CACHE_DISABLED,
+	CACHE_HIT,
+	CACHE_MISS, // no cache file (or it couldn't be read)
+	CACHE_STALE // the cache file was for different source or a different version
+} CacheStatus;
+
+typedef struct {
+	CacheStatus status;
+	char *path;
+	bool written;
+	size_t bytes; // size of the cache file that was read or written
+	double hash_seconds;
+	double load_seconds;
+	double compile_seconds; // parsing and compiling on a miss
+	double write_seconds;
+} CacheStats;
+
+extern char *cache_path(char *source_path);
+
+// the key for a loaded source file, including a 128 bit hash of all of it
+extern SourceKey source_key(SourceFile *source);
+
+// maps the cache file in and points program straight at it. fails (and leaves
+// program alone) if the file is missing or doesn't match the source
+extern CacheStatus load_cached_program(char *path, SourceKey *key, Program *program, size_t *bytes);
+
+// writes to a temporary file and renames it over the cache file, so a run
+// never sees a half written one. returns the number of bytes written, or 0 if
+// it couldn't be written (which just means there's no cache next time)
+extern size_t write_cached_program(char *path, SourceKey *key, Program *program);
+
+extern void print_cache_stats(CacheStats *stats);
+
+#endif  // INCLUDE_CACHE_H
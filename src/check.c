@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "parser.h"
+#include "compiler.h"
+#include "scan.h"
+#include "workers.h"
+#include "utils.h"
+
+typedef struct {
+	char *path;
+	bool readable;
+	size_t bytes;
+	size_t errors;
+	double seconds;
+
+	// everything to print for the file, written while it's checked so it can be
+	// printed in order afterwards
+	char *output;
+	size_t output_length;
+} CheckedFile;
+
+typedef struct {
+	CheckedFile *files;
+	size_t length, capacity;
+} FileList;
+
+static void add_file(FileList *list, char *path) {
+	if (list->length == list->capacity) {
+		list->capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+		list->files = realloc(list->files, sizeof(CheckedFile) * list->capacity);
+		ensure_alloc(list->files);
+	}
+
+	list->files[list->length++] = (CheckedFile){ .path = path };
+}
+
+static bool is_basic_file(char *name) {
+	size_t length = strlen(name);
+	return length > 4 && strcasecmp(name + length - 4, ".bas") == 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+static char *join_path(char *directory, char *name) {
+	size_t directory_length = strlen(directory);
+	bool has_slash = directory_length > 0 && directory[directory_length - 1] == '/';
+
+	char *path = malloc(directory_length + strlen(name) + 2);
+	ensure_alloc(path);
+	sprintf(path, has_slash ? "%s%s" : "%s/%s", directory, name);
+
+	return path;
+}
+
+// adds every .bas file under directory, going through its entries in order of
+// name so the list comes out the same however the file system orders them
+static void collect_directory(FileList *list, char *directory) {
+	DIR *dir = opendir(directory);
+	if (dir == NULL) {
+		add_file(list, strdup(directory));
+		return;
+	}
+
+	char **names = NULL;
+	size_t length = 0, capacity = 0;
+	struct dirent *entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+		if (length == capacity) {
+			capacity = capacity == 0 ? 16 : capacity * 2;
+			names = realloc(names, sizeof(char *) * capacity);
+			ensure_alloc(names);
+		}
+
+		names[length] = strdup(entry->d_name);
+		ensure_alloc(names[length++]);
+	}
+
+	closedir(dir);
+	qsort(names, length, sizeof(char *), compare_names);
+
+	for (size_t i = 0; i < length; i++) {
+		char *path = join_path(directory, names[i]);
+		struct stat path_stat;
+
+		if (stat(path, &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+			collect_directory(list, path);
+			free(path);
+		} else if (is_basic_file(names[i])) {
+			add_file(list, path);
+		} else {
+			free(path);
+		}
+
+		free(names[i]);
+	}
+
+	free(names);
+}
+
+static void check_file(void *context, size_t task) {
+	CheckedFile *file = &((CheckedFile *)context)[task];
+	FILE *out = open_memstream(&file->output, &file->output_length);
+	ensure_alloc(out);
+
+	double start = monotonic_seconds();
+	SourceFile source;
+	file->readable = try_load_source(file->path, &source);
+
+	if (file->readable) {
+		ParserResult result = parse(source.code);
+		ErrorList errors = { NULL, 0, false };
+
+		// compiling is what finds jumps to lines that don't exist
+		if (result.success) {
+			CompileResult compile_result = compile(result.result.ast);
+			free_ast(result.result.ast);
+
+			if (compile_result.success) free_program(compile_result.result.program);
+			else errors = compile_result.result.errors;
+		} else {
+			errors = result.result.errors;
+		}
+
+		if (errors.length > 0) {
+			file->errors = errors.length;
+
+			for (size_t i = 0; i < errors.length; i++)
+				print_error(out, errors.errors[i], source.code);
+
+			free_error_list(errors);
+		}
+
+		file->bytes = source.length;
+		free_source(source);
+	}
+
+	file->seconds = monotonic_seconds() - start;
+	fclose(out);
+}
+
+int check_paths(char **paths, size_t path_count, size_t thread_count) {
+	FileList list = { NULL, 0, 0 };
+
+	for (size_t i = 0; i < path_count; i++) {
+		struct stat path_stat;
+		if (stat(paths[i], &path_stat) == 0 && S_ISDIR(path_stat.st_mode))
+			collect_directory(&list, paths[i]);
+		else
+			add_file(&list, strdup(paths[i]));
+	}
+
+	// picked here so the lexers on the workers find it already chosen
+	select_scanner();
+
+	double start = monotonic_seconds();
+	run_tasks(list.length, thread_count, check_file, list.files);
+	double seconds = monotonic_seconds() - start;
+
+	size_t failed = 0, bytes = 0;
+
+	for (size_t i = 0; i < list.length; i++) {
+		CheckedFile *file = &list.files[i];
+
+		if (!file->readable) {
+			printf("%s: could not read file\n", file->path);
+			failed++;
+		} else if (file->errors > 0) {
+			printf("%s: %zu error%s (%.2f ms)\n", file->path, file->errors, file->errors == 1 ? "" : "s", file->seconds * 1e3);
+			fwrite(file->output, 1, file->output_length, stdout);
+			failed++;
+		} else {
+			printf("%s: ok (%.2f ms)\n", file->path, file->seconds * 1e3);
+		}
+
+		bytes += file->bytes;
+		free(file->output);
+		free(file->path);
+	}
+
+	printf(
+		"\nChecked %zu file%s (%.2f MB) in %.3f s on %zu thread%s: %zu ok, %zu failed\n",
+		list.length, list.length == 1 ? "" : "s", bytes / 1e6, seconds,
+		thread_count, thread_count == 1 ? "" : "s", list.length - failed, failed
+	);
+
+	if (seconds > 0)
+		printf("%.0f files/s, %.2f MB/s\n", list.length / seconds, bytes / 1e6 / seconds);
+
+	free(list.files);
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,13 @@
+#ifndef INCLUDE_CHECK_H
+#define INCLUDE_CHECK_H
+
+#include <stddef.h>
+
+// parses every file in paths, and every .bas file in any directories under
+// them, without running anything. files are spread across thread_count
+// threads but the results are always printed in the same order: arguments in
+// the order they were given, and directories sorted by name. returns the
+// status to exit with
+extern int check_paths(char **paths, size_t path_count, size_t thread_count);
+
+#endif  // INCLUDE_CHECK_H
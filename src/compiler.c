@@ -0,0 +1,438 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "compiler.h"
+#include "builtins.h"
+#include "utils.h"
+#include "stats.h"
+
+char *stringify_opcode(Opcode opcode) {
+	switch (opcode) {
+		case OP_PUSH_NUMBER: return "PUSH_NUMBER";
+		case OP_PUSH_STRING: return "PUSH_STRING";
+		case OP_LOAD_VAR: return "LOAD_VAR";
+		case OP_STORE_VAR: return "STORE_VAR";
+		case OP_LOAD_STRING_VAR: return "LOAD_STRING_VAR";
+		case OP_STORE_STRING_VAR: return "STORE_STRING_VAR";
+		case OP_TAKE_STRING_VAR: return "TAKE_STRING_VAR";
+		case OP_ADD: return "ADD";
+		case OP_SUBTRACT: return "SUBTRACT";
+		case OP_MULTIPLY: return "MULTIPLY";
+		case OP_DIVIDE: return "DIVIDE";
+		case OP_POWER: return "POWER";
+		case OP_EQUAL: return "EQUAL";
+		case OP_NOT_EQUAL: return "NOT_EQUAL";
+		case OP_LESS: return "LESS";
+		case OP_LESS_EQUAL: return "LESS_EQUAL";
+		case OP_GREATER: return "GREATER";
+		case OP_GREATER_EQUAL: return "GREATER_EQUAL";
+		case OP_NEGATE: return "NEGATE";
+		case OP_CONCAT: return "CONCAT";
+		case OP_CALL_BUILTIN: return "CALL_BUILTIN";
+		case OP_PRINT: return "PRINT";
+		case OP_PRINT_ZONE: return "PRINT_ZONE";
+		case OP_PRINT_NEWLINE: return "PRINT_NEWLINE";
+		case OP_JUMP: return "JUMP";
+		case OP_JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+		case OP_JUMP_IF_TRUE: return "JUMP_IF_TRUE";
+		case OP_GOSUB: return "GOSUB";
+		case OP_RETURN: return "RETURN";
+		case OP_HALT: return "HALT";
+		case OP_JIT_ENTRY: return "JIT_ENTRY";
+		case OP_PROFILE_ENTRY: return "PROFILE_ENTRY";
+	}
+
+	return "UNKNOWN";
+}
+
+void free_program(Program program) {
+	// only the arrays of pointers into a mapped program were allocated
+	if (program.mapping != NULL) {
+		free(program.strings);
+		free(program.variables);
+		munmap(program.mapping, program.mapping_length);
+		return;
+	}
+
+	for (size_t i = 0; i < program.strings_length; i++)
+		free(program.strings[i]);
+
+	for (size_t i = 0; i < program.variables_length; i++)
+		free(program.variables[i]);
+
+	free(program.code);
+	free(program.numbers);
+	free(program.strings);
+	free(program.variables);
+	free(program.statement_lines);
+}
+
+// grows an array to fit at least one more element, doubling its capacity
+static void *grow(void *array, size_t *capacity, size_t length, size_t element_size) {
+	if (length < *capacity) return array;
+
+	*capacity = *capacity == 0 ? 16 : *capacity * 2;
+	array = realloc(array, *capacity * element_size);
+	ensure_alloc(array);
+	count_alloc(STATS_COMPILER, *capacity * element_size);
+
+	return array;
+}
+
+// how many values each instruction leaves on the stack (or takes off it)
+static int stack_effect(Opcode opcode, uint32_t operand) {
+	switch (opcode) {
+		case OP_PUSH_NUMBER:
+		case OP_PUSH_STRING:
+		case OP_LOAD_VAR:
+		case OP_LOAD_STRING_VAR:
+		case OP_TAKE_STRING_VAR: return 1;
+		case OP_STORE_VAR:
+		case OP_STORE_STRING_VAR:
+		case OP_ADD:
+		case OP_SUBTRACT:
+		case OP_MULTIPLY:
+		case OP_DIVIDE:
+		case OP_POWER:
+		case OP_EQUAL:
+		case OP_NOT_EQUAL:
+		case OP_LESS:
+		case OP_LESS_EQUAL:
+		case OP_GREATER:
+		case OP_GREATER_EQUAL:
+		case OP_CONCAT:
+		case OP_JUMP_IF_FALSE:
+		case OP_JUMP_IF_TRUE:
+		case OP_PRINT: return -1;
+		case OP_CALL_BUILTIN: return 1 - (int)builtins[operand].arity;
+		default: return 0;
+	}
+}
+
+void emit(Compiler *compiler, Opcode opcode, uint32_t operand) {
+	Program *program = &compiler->program;
+
+	program->code = grow(program->code, &compiler->capacity, program->length, sizeof(Instruction));
+	program->code[program->length++] = (Instruction){ opcode, operand };
+
+	compiler->stack_depth += stack_effect(opcode, operand);
+	if (compiler->stack_depth > program->max_stack_depth)
+		program->max_stack_depth = compiler->stack_depth;
+}
+
+uint32_t add_number_constant(Compiler *compiler, double number) {
+	Program *program = &compiler->program;
+
+	program->numbers = grow(
+		program->numbers, &compiler->numbers_capacity, program->numbers_length, sizeof(double)
+	);
+	program->numbers[program->numbers_length] = number;
+
+	return program->numbers_length++;
+}
+
+uint32_t add_string_constant(Compiler *compiler, StringSlice string) {
+	Program *program = &compiler->program;
+
+	program->strings = grow(
+		program->strings, &compiler->strings_capacity, program->strings_length, sizeof(char *)
+	);
+	program->strings[program->strings_length] = strndup(string.chars, string.length);
+	ensure_alloc(program->strings[program->strings_length]);
+	count_alloc(STATS_COMPILER, string.length + 1);
+
+	return program->strings_length++;
+}
+
+void add_label(Compiler *compiler, LineNumber line_number) {
+	compiler->labels = grow(compiler->labels, &compiler->labels_capacity, compiler->labels_length, sizeof(LineLabel));
+	compiler->labels[compiler->labels_length++] = (LineLabel){ line_number, compiler->program.length };
+}
+
+// jumps are emitted without anywhere to go, and get filled in by resolve_jumps
+// once every line number's been seen
+void emit_jump(Compiler *compiler, Opcode opcode, LineNumber target) {
+	compiler->jumps = grow(compiler->jumps, &compiler->jumps_capacity, compiler->jumps_length, sizeof(PendingJump));
+	compiler->jumps[compiler->jumps_length++] = (PendingJump){ target, compiler->program.length };
+	emit(compiler, opcode, 0);
+}
+
+// the nodes of an expression are in post-order, which is exactly the order
+// the stack machine wants them in, so it compiles in one sweep
+static void compile_nodes(Compiler *compiler, ExprPool *pool, ExprIndex first, ExprIndex last) {
+	for (ExprIndex i = first; i <= last; i++) {
+		switch (pool->kinds[i]) {
+			case EXPR_NUMBER:
+				emit(compiler, OP_PUSH_NUMBER, add_number_constant(compiler, pool->values[i].number));
+				break;
+			case EXPR_STRING:
+				emit(compiler, OP_PUSH_STRING, add_string_constant(compiler, pool->strings[pool->values[i].string]));
+				break;
+			case EXPR_VAR: {
+				Symbol variable = pool->values[i].variable;
+				emit(compiler, symbol_is_string(compiler->symbols, variable) ? OP_LOAD_STRING_VAR : OP_LOAD_VAR, variable);
+				break;
+			}
+			case EXPR_NEGATE:
+				emit(compiler, OP_NEGATE, 0);
+				break;
+			case EXPR_BUILTIN:
+				emit(compiler, OP_CALL_BUILTIN, pool->ops[i]);
+				break;
+			case EXPR_BINARY:
+				switch (pool->ops[i]) {
+					case '+': emit(compiler, OP_ADD, 0); break;
+					case '-': emit(compiler, OP_SUBTRACT, 0); break;
+					case '*': emit(compiler, OP_MULTIPLY, 0); break;
+					case '/': emit(compiler, OP_DIVIDE, 0); break;
+					case '^': emit(compiler, OP_POWER, 0); break;
+					case '=': emit(compiler, OP_EQUAL, 0); break;
+					case COMPARE_NOT_EQUAL: emit(compiler, OP_NOT_EQUAL, 0); break;
+					case '<': emit(compiler, OP_LESS, 0); break;
+					case COMPARE_LESS_EQUAL: emit(compiler, OP_LESS_EQUAL, 0); break;
+					case '>': emit(compiler, OP_GREATER, 0); break;
+					case COMPARE_GREATER_EQUAL: emit(compiler, OP_GREATER_EQUAL, 0); break;
+				}
+				break;
+			case EXPR_CONCAT:
+				emit(compiler, OP_CONCAT, 0);
+				break;
+		}
+	}
+}
+
+void compile_expr(Compiler *compiler, ExprPool *pool, ExprIndex expr) {
+	compile_nodes(compiler, pool, expr_start(pool, expr), expr);
+}
+
+// whether an expression is variable + something that doesn't use the
+// variable again, so the variable's string can be added to where it is
+static bool appends_to_variable(ExprPool *pool, ExprIndex expr, Symbol variable) {
+	if (pool->kinds[expr] != EXPR_CONCAT) return false;
+
+	ExprIndex start = expr_start(pool, expr);
+	if (pool->kinds[start] != EXPR_VAR || pool->values[start].variable != variable) return false;
+
+	for (ExprIndex i = start + 1; i < expr; i++)
+		if (pool->kinds[i] == EXPR_VAR && pool->values[i].variable == variable) return false;
+
+	return true;
+}
+
+// ends the chain of JUMP_IF_FALSEs in a chain of IFs
+#define NO_SKIP UINT32_MAX
+
+// line numbers don't have any code of their own, so they don't get an entry
+static void add_statement_line(Compiler *compiler, Statement statement) {
+	Program *program = &compiler->program;
+
+	program->statement_lines = grow(
+		program->statement_lines, &compiler->statement_lines_capacity,
+		program->statement_lines_length, sizeof(StatementLine)
+	);
+	program->statement_lines[program->statement_lines_length++] = (StatementLine){
+		program->length, statement.line, statement.column
+	};
+}
+
+void compile_statement(Compiler *compiler, ExprPool *pool, Statement statement) {
+	if (statement.type != STATEMENT_LABEL) add_statement_line(compiler, statement);
+
+	switch (statement.type) {
+		case STATEMENT_ASSIGNMENT: {
+			Symbol variable = statement.statement.assignment.variable;
+			ExprIndex expr = statement.statement.assignment.expr;
+
+			if (!symbol_is_string(compiler->symbols, variable)) {
+				compile_expr(compiler, pool, expr);
+				emit(compiler, OP_STORE_VAR, variable);
+				break;
+			}
+
+			// with let s$ = s$ + ..., taking the string instead of loading a copy
+			// means the only reference to it is on the stack, so the joins can
+			// grow it in place rather than copying the whole thing every time
+			if (appends_to_variable(pool, expr, variable)) {
+				emit(compiler, OP_TAKE_STRING_VAR, variable);
+				compile_nodes(compiler, pool, expr_start(pool, expr) + 1, expr);
+			} else compile_expr(compiler, pool, expr);
+
+			emit(compiler, OP_STORE_STRING_VAR, variable);
+			break;
+		}
+		case STATEMENT_PRINT: {
+			ExprList *exprs = statement.statement.print;
+
+			for (size_t i = 0; i < exprs->length; i++) {
+				compile_expr(compiler, pool, exprs->exprs[i]);
+				emit(compiler, OP_PRINT, 0);
+
+				// semicolons join items together whereas commas move to the next zone
+				if (i < exprs->delimiters_length && exprs->delimiters[i] == ',')
+					emit(compiler, OP_PRINT_ZONE, 0);
+			}
+
+			// a trailing delimiter stops the newline from being printed
+			if (exprs->delimiters_length < exprs->length || exprs->length == 0)
+				emit(compiler, OP_PRINT_NEWLINE, 0);
+
+			break;
+		}
+		case STATEMENT_LABEL:
+			add_label(compiler, statement.statement.label);
+			break;
+		case STATEMENT_GOTO:
+			emit_jump(compiler, OP_JUMP, statement.statement.jump);
+			break;
+		case STATEMENT_GOSUB:
+			emit_jump(compiler, OP_GOSUB, statement.statement.jump);
+			break;
+		case STATEMENT_RETURN:
+			emit(compiler, OP_RETURN, 0);
+			break;
+		case STATEMENT_END:
+			emit(compiler, OP_HALT, 0);
+			break;
+		case STATEMENT_IF: {
+			// a chain of IFs is compiled in a loop rather than by recursing, so a
+			// long one can't overflow the stack. until they can be patched, each
+			// JUMP_IF_FALSE's operand is the one before it in the chain
+			uint32_t skips = NO_SKIP;
+
+			while (true) {
+				Statement *then = statement.statement.if_then.then;
+				compile_expr(compiler, pool, statement.statement.if_then.condition);
+
+				// IF ... THEN GOTO is just one conditional jump
+				if (then->type == STATEMENT_GOTO) {
+					emit_jump(compiler, OP_JUMP_IF_TRUE, then->statement.jump);
+					break;
+				}
+
+				uint32_t skip = compiler->program.length;
+				emit(compiler, OP_JUMP_IF_FALSE, skips);
+				skips = skip;
+
+				if (then->type != STATEMENT_IF) {
+					compile_statement(compiler, pool, *then);
+					break;
+				}
+
+				statement = *then;
+				add_statement_line(compiler, statement);
+			}
+
+			while (skips != NO_SKIP) {
+				uint32_t next = compiler->program.code[skips].operand;
+				compiler->program.code[skips].operand = compiler->program.length;
+				skips = next;
+			}
+			break;
+		}
+	}
+}
+
+static int compare_labels(const void *a, const void *b) {
+	const LineNumber *lhs = &((const LineLabel *)a)->line_number;
+	const LineNumber *rhs = &((const LineLabel *)b)->line_number;
+
+	if (lhs->number != rhs->number) return lhs->number < rhs->number ? -1 : 1;
+	return (lhs->line > rhs->line) - (lhs->line < rhs->line);
+}
+
+static LineLabel *find_label(Compiler *compiler, uint32_t number) {
+	size_t low = 0, high = compiler->labels_length;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (compiler->labels[middle].line_number.number < number) low = middle + 1;
+		else high = middle;
+	}
+
+	if (low < compiler->labels_length && compiler->labels[low].line_number.number == number)
+		return &compiler->labels[low];
+
+	return NULL;
+}
+
+static Error line_number_error(LineNumber line_number, char *before, char *after) {
+	StringBuilder message = new_string_builder(64);
+	builder_append_str(&message, before);
+	builder_append_number(&message, line_number.number);
+	builder_append_str(&message, after);
+	return (Error){ message.chars, line_number.line, line_number.column, -1 };
+}
+
+// points every jump straight at the instruction its line starts at, so the vm
+// never has to look a line up. the labels are sorted into a table with one
+// entry per line number that's actually used, so spreading the numbers out
+// doesn't cost any memory
+static ErrorList resolve_jumps(Compiler *compiler) {
+	ErrorList errors = { NULL, 0, false };
+	size_t errors_capacity = 0;
+
+	// labels is still NULL if there weren't any, which qsort mustn't be given
+	if (compiler->labels_length > 0)
+		qsort(compiler->labels, compiler->labels_length, sizeof(LineLabel), compare_labels);
+
+	for (size_t i = 1; i < compiler->labels_length; i++) {
+		LineNumber line_number = compiler->labels[i].line_number;
+		if (line_number.number != compiler->labels[i - 1].line_number.number) continue;
+
+		Error error = line_number_error(line_number, "Line number ", " is used more than once");
+		if (!add_error(&errors, &errors_capacity, error)) return errors;
+	}
+
+	for (size_t i = 0; i < compiler->jumps_length; i++) {
+		PendingJump jump = compiler->jumps[i];
+		LineLabel *label = find_label(compiler, jump.target.number);
+
+		if (label != NULL) {
+			compiler->program.code[jump.instruction].operand = label->offset;
+			continue;
+		}
+
+		Error error = line_number_error(jump.target, "There is no line ", "");
+		if (!add_error(&errors, &errors_capacity, error)) return errors;
+	}
+
+	return errors;
+}
+
+CompileResult compile(AST ast) {
+	double start = start_phase();
+	Compiler compiler = { .symbols = &ast.symbols };
+
+	for (size_t i = 0; i < ast.length; i++)
+		compile_statement(&compiler, &ast.exprs, ast.statements[i]);
+
+	emit(&compiler, OP_HALT, 0);
+
+	ErrorList errors = resolve_jumps(&compiler);
+	free(compiler.labels);
+	free(compiler.jumps);
+
+	if (errors.length > 0) {
+		free_program(compiler.program);
+		end_phase(PHASE_COMPILE, start);
+		return (CompileResult){ false, { .errors = errors } };
+	}
+
+	// every symbol gets a variable slot (even ones that turn out to be function
+	// names) so variables can be indexed by symbol directly
+	Program *program = &compiler.program;
+	program->variables_length = ast.symbols.length;
+	program->variables = malloc(sizeof(char *) * program->variables_length);
+	ensure_alloc(program->variables);
+	count_alloc(STATS_COMPILER, sizeof(char *) * program->variables_length);
+
+	for (size_t i = 0; i < program->variables_length; i++) {
+		program->variables[i] = strdup(symbol_name((SymbolTable *)&ast.symbols, i));
+		ensure_alloc(program->variables[i]);
+		count_alloc(STATS_COMPILER, strlen(program->variables[i]) + 1);
+	}
+
+	end_phase(PHASE_COMPILE, start);
+	return (CompileResult){ true, { .program = compiler.program } };
+}
@@ -0,0 +1,131 @@
+#ifndef INCLUDE_COMPILER_H
+#define INCLUDE_COMPILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+typedef enum {
+	OP_PUSH_NUMBER,
+	OP_PUSH_STRING,
+	OP_LOAD_VAR,
+	OP_STORE_VAR,
+	OP_LOAD_STRING_VAR, // string variables hold references, so these count them
+	OP_STORE_STRING_VAR,
+	OP_TAKE_STRING_VAR, // moves a string out of its variable, leaving ""
+	OP_ADD,
+	OP_SUBTRACT,
+	OP_MULTIPLY,
+	OP_DIVIDE,
+	OP_POWER,
+	OP_EQUAL,
+	OP_NOT_EQUAL,
+	OP_LESS,
+	OP_LESS_EQUAL,
+	OP_GREATER,
+	OP_GREATER_EQUAL,
+	OP_NEGATE,
+	OP_CONCAT,
+	OP_CALL_BUILTIN,
+	OP_PRINT,
+	OP_PRINT_ZONE,
+	OP_PRINT_NEWLINE,
+	OP_JUMP,
+	OP_JUMP_IF_FALSE,
+	OP_JUMP_IF_TRUE,
+	OP_GOSUB,
+	OP_RETURN,
+	OP_HALT,
+	OP_JIT_ENTRY, // never compiled, only patched into the jit's copy of the code
+	OP_PROFILE_ENTRY // the same, for the profiler's copy
+} Opcode;
+
+extern char *stringify_opcode(Opcode opcode);
+
+// operands are always indices (into the constants, variables or builtins, or
+// the code itself for jumps) so a program doesn't contain any pointers
+typedef struct {
+	uint8_t opcode;
+	uint32_t operand;
+} Instruction;
+
+// where each statement's code starts, in order, so the profiler can tell
+// which line is running
+typedef struct {
+	uint32_t offset;
+	uint32_t line, column;
+} StatementLine;
+
+typedef struct {
+	Instruction *code;
+	size_t length;
+
+	double *numbers;
+	size_t numbers_length;
+
+	char **strings;
+	size_t strings_length;
+
+	char **variables; // names of the variables in each slot
+	size_t variables_length;
+
+	size_t max_stack_depth;
+
+	StatementLine *statement_lines;
+	size_t statement_lines_length;
+
+	// set when the program was loaded from a cache file, in which case the
+	// code, constants and names all point into this mapping
+	void *mapping;
+	size_t mapping_length;
+} Program;
+
+extern void free_program(Program program);
+
+// where each line number's statements start, and the jumps that still need
+// to be pointed at one
+typedef struct {
+	LineNumber line_number;
+	uint32_t offset;
+} LineLabel;
+
+typedef struct {
+	LineNumber target;
+	uint32_t instruction;
+} PendingJump;
+
+typedef struct {
+	Program program;
+	SymbolTable *symbols;
+	size_t capacity, numbers_capacity, strings_capacity, statement_lines_capacity;
+	size_t stack_depth;
+
+	LineLabel *labels;
+	size_t labels_length, labels_capacity;
+	PendingJump *jumps;
+	size_t jumps_length, jumps_capacity;
+} Compiler;
+
+typedef struct {
+	bool success;
+	union {
+		Program program;
+		ErrorList errors;
+	} result;
+} CompileResult;
+
+extern void emit(Compiler *compiler, Opcode opcode, uint32_t operand);
+extern uint32_t add_number_constant(Compiler *compiler, double number);
+extern uint32_t add_string_constant(Compiler *compiler, StringSlice string);
+extern void add_label(Compiler *compiler, LineNumber line_number);
+extern void emit_jump(Compiler *compiler, Opcode opcode, LineNumber target);
+
+extern void compile_expr(Compiler *compiler, ExprPool *pool, ExprIndex expr);
+extern void compile_statement(Compiler *compiler, ExprPool *pool, Statement statement);
+
+// fails if any jump goes to a line that doesn't exist (or to one that's
+// numbered more than once)
+extern CompileResult compile(AST ast);
+
+#endif  // INCLUDE_COMPILER_H
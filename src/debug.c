@@ -1,27 +1,31 @@
+#include <stdlib.h>
 #include <stdio.h>
 
 #include "debug.h"
 #include "parser.h"
+#include "builtins.h"
 
-void print_token(Token token) {
+void print_token(Token token, char *code) {
 	printf("%s ", stringify_token_type(token.type));
-	if (token.string_literal != NULL)
-		printf("\"%s\" ", token.string_literal);
+	if (token.type == TOKEN_NUMBER)
+		printf("%g ", token.number_literal);
+	else if (token.type == TOKEN_NAME || token.type == TOKEN_STRING)
+		printf("\"%.*s\" ", (int)token.length, code + token.start);
 	else if (token.char_literal != '\0')
 		printf("'%c' ", token.char_literal);
 	printf("at %zu:%zu", token.line, token.column);
 }
 
-void print_token_buffer_range(TokenBuffer buffer, size_t start, size_t end) {
+void print_token_buffer_range(TokenBuffer buffer, char *code, size_t start, size_t end) {
 	for (size_t i = start; i < end; i++) {
 		printf("  ");
-		print_token(buffer.tokens[i]);
+		print_token(buffer.tokens[i], code);
 		if (i < end - 1) printf(",");
 		printf("\n");
 	}
 }
 
-void print_token_buffer(TokenBuffer buffer) {
+void print_token_buffer(TokenBuffer buffer, char *code) {
 	if (buffer.length == 0) {
 		printf("[]\n");
 		return;
@@ -29,35 +33,85 @@ void print_token_buffer(TokenBuffer buffer) {
 
 	printf("[\n  cap = %zu,\n  len = %zu,\n  next = %zu,\n  peeked = %d\n  ----------\n", buffer.capacity, buffer.length, buffer.next_index, buffer.peeked);
 
-	if (buffer.next_index == 0) print_token_buffer_range(buffer, 0, buffer.length);
+	if (buffer.next_index == 0) print_token_buffer_range(buffer, code, 0, buffer.length);
 	else {
-		print_token_buffer_range(buffer, buffer.next_index, buffer.length);
-		print_token_buffer_range(buffer, 0, buffer.next_index);
+		print_token_buffer_range(buffer, code, buffer.next_index, buffer.length);
+		print_token_buffer_range(buffer, code, 0, buffer.next_index);
 	}
 
 	printf("]\n");
 }
 
-void print_expr(Expr expr) {
-	switch (expr.type) {
-		case EXPR_NUMBER: printf("%s", expr.expr.number_literal); break;
-		case EXPR_STRING: printf("\"%s\"", expr.expr.string_literal); break;
-		case EXPR_VAR: printf("%s", expr.expr.variable); break;
-		case EXPR_CALL:
-			if (expr.expr.call.name_string != NULL)
-				printf("(%s", expr.expr.call.name_string);
-			else
-				printf("(%c", expr.expr.call.name_char);
-			for (size_t i = 0; i < expr.expr.call.args->length; i++) {
-				printf(" ");
-				print_expr(expr.expr.call.args->exprs[i]);
+// what print_expr has left to print: an expression, or the text between them
+typedef struct {
+	ExprIndex expr;
+	const char *text;
+} PrintItem;
+
+static void push_item(PrintItem **items, size_t *length, size_t *capacity, PrintItem item) {
+	if (*length == *capacity) {
+		*capacity = *capacity == 0 ? 64 : *capacity * 2;
+		*items = realloc(*items, sizeof(PrintItem) * *capacity);
+		ensure_alloc(*items);
+	}
+
+	(*items)[(*length)++] = item;
+}
+
+// works through a stack of what's left to print rather than recursing, so
+// deeply nested expressions can be printed too
+void print_expr(ExprPool *pool, ExprIndex expr, SymbolTable *symbols) {
+	PrintItem *items = NULL;
+	size_t length = 0, capacity = 0;
+	push_item(&items, &length, &capacity, (PrintItem){ expr, NULL });
+
+	while (length > 0) {
+		PrintItem item = items[--length];
+		expr = item.expr;
+
+		if (item.text != NULL) {
+			printf("%s", item.text);
+			continue;
+		}
+
+		switch (pool->kinds[expr]) {
+			case EXPR_NUMBER: printf("%g", pool->values[expr].number); break;
+			case EXPR_STRING: {
+				StringSlice string = pool->strings[pool->values[expr].string];
+				printf("\"%.*s\"", (int)string.length, string.chars);
+				break;
 			}
-			printf(")");
-			break;
+			case EXPR_VAR: printf("%s", symbol_name(symbols, pool->values[expr].variable)); break;
+			case EXPR_NEGATE:
+			case EXPR_BUILTIN:
+				if (pool->kinds[expr] == EXPR_NEGATE) printf("(- ");
+				else printf("(%s ", builtins[pool->ops[expr]].name);
+
+				push_item(&items, &length, &capacity, (PrintItem){ 0, ")" });
+				push_item(&items, &length, &capacity, (PrintItem){ expr - 1, NULL });
+				break;
+			case EXPR_BINARY:
+			case EXPR_CONCAT:
+				switch (pool->ops[expr]) {
+					case COMPARE_NOT_EQUAL: printf("(<> "); break;
+					case COMPARE_LESS_EQUAL: printf("(<= "); break;
+					case COMPARE_GREATER_EQUAL: printf("(>= "); break;
+					default: printf("(%c ", pool->ops[expr]);
+				}
+
+				// pushed backwards so they come off in the right order
+				push_item(&items, &length, &capacity, (PrintItem){ 0, ")" });
+				push_item(&items, &length, &capacity, (PrintItem){ expr - 1, NULL });
+				push_item(&items, &length, &capacity, (PrintItem){ 0, " " });
+				push_item(&items, &length, &capacity, (PrintItem){ pool->values[expr].lhs, NULL });
+				break;
+		}
 	}
+
+	free(items);
 }
 
-void print_expr_list(ExprList *exprs) {
+void print_expr_list(ExprPool *pool, ExprList *exprs, SymbolTable *symbols) {
 	if (exprs->length == 0) {
 		printf("[]");
 		return;
@@ -66,10 +120,44 @@ void print_expr_list(ExprList *exprs) {
 	printf("[");
 
 	for (size_t i = 0; i < exprs->length; i++) {
-		print_expr(exprs->exprs[i]);
+		print_expr(pool, exprs->exprs[i], symbols);
 		if (i < exprs->length - 1)
-			printf(exprs->store_delimiters ? (char[]){exprs->delimiters.buffer[i], ' ', '\0'} : " ");
+			printf(exprs->store_delimiters ? (char[]){exprs->delimiters[i], ' ', '\0'} : " ");
 	}
 
 	printf("]");
 }
+
+void print_statement(ExprPool *pool, Statement statement, SymbolTable *symbols) {
+	// a chain of IFs is printed in a loop, so a long one can't overflow the stack
+	while (statement.type == STATEMENT_IF) {
+		printf("if ");
+		print_expr(pool, statement.statement.if_then.condition, symbols);
+		printf(" then ");
+		statement = *statement.statement.if_then.then;
+	}
+
+	switch (statement.type) {
+		case STATEMENT_ASSIGNMENT:
+			printf("let %s = ", symbol_name(symbols, statement.statement.assignment.variable));
+			print_expr(pool, statement.statement.assignment.expr, symbols);
+			break;
+		case STATEMENT_PRINT:
+			printf("print ");
+			print_expr_list(pool, statement.statement.print, symbols);
+			break;
+		case STATEMENT_LABEL: printf("line %u", statement.statement.label.number); break;
+		case STATEMENT_GOTO: printf("goto %u", statement.statement.jump.number); break;
+		case STATEMENT_GOSUB: printf("gosub %u", statement.statement.jump.number); break;
+		case STATEMENT_RETURN: printf("return"); break;
+		case STATEMENT_END: printf("end"); break;
+		case STATEMENT_IF: break; // printed above
+	}
+}
+
+void print_ast(AST *ast) {
+	for (size_t i = 0; i < ast->length; i++) {
+		print_statement(&ast->exprs, ast->statements[i], &ast->symbols);
+		printf("\n");
+	}
+}
@@ -4,11 +4,13 @@
 #include "lexer.h"
 #include "parser.h"
 
-extern void print_token(Token token);
-extern void _print_token_buffer_from(TokenBuffer buffer, size_t start, size_t end);
-extern void print_token_buffer(TokenBuffer buffer);
+extern void print_token(Token token, char *code);
+extern void print_token_buffer_range(TokenBuffer buffer, char *code, size_t start, size_t end);
+extern void print_token_buffer(TokenBuffer buffer, char *code);
 
-extern void print_expr(Expr expr);
-extern void print_expr_list(ExprList *exprs);
+extern void print_expr(ExprPool *pool, ExprIndex expr, SymbolTable *symbols);
+extern void print_expr_list(ExprPool *pool, ExprList *exprs, SymbolTable *symbols);
+extern void print_statement(ExprPool *pool, Statement statement, SymbolTable *symbols);
+extern void print_ast(AST *ast);
 
 #endif  // INCLUDE_DEBUG_H
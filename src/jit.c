@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "jit.h"
+#include "builtins.h"
+#include "utils.h"
+#include "stats.h"
+
+#ifdef HAVE_JIT
+#include <sys/mman.h>
+#endif
+
+JitMode jit_mode = JIT_ON;
+
+// regions shorter than this (like let a = b) aren't worth the call
+#define JIT_MIN_REGION_LENGTH 3
+
+#define JIT_BLOCK_SIZE (64 * 1024)
+
+// finds every run of instructions that works out a number and stores it in a
+// variable. statements always leave the stack empty and jumps only ever land
+// between statements, so a run that starts after anything else and ends in a
+// store is a whole assignment that can't be jumped into
+static void find_regions(Jit *jit) {
+	Program *program = jit->program;
+	size_t capacity = 0;
+	uint32_t start = 0;
+	int depth = 0, max_depth = 0;
+
+	for (uint32_t i = 0; i < program->length; i++) {
+		Instruction instruction = program->code[i];
+		bool pure = true;
+
+		switch (instruction.opcode) {
+			case OP_PUSH_NUMBER:
+			case OP_LOAD_VAR: // string variables have their own opcodes, so this is a number
+				depth++;
+				break;
+			case OP_ADD:
+			case OP_SUBTRACT:
+			case OP_MULTIPLY:
+			case OP_DIVIDE:
+			case OP_POWER:
+				pure = depth >= 2;
+				depth--;
+				break;
+			case OP_NEGATE: pure = depth >= 1; break;
+			case OP_CALL_BUILTIN: pure = depth >= 1 && builtins[instruction.operand].arity == 1; break;
+			case OP_STORE_VAR:
+				if (depth == 1 && max_depth <= JIT_MAX_DEPTH && i + 1 - start >= JIT_MIN_REGION_LENGTH) {
+					if (jit->regions_length == capacity) {
+						capacity = capacity == 0 ? 16 : capacity * 2;
+						jit->regions = realloc(jit->regions, sizeof(JitRegion) * capacity);
+						ensure_alloc(jit->regions);
+						count_alloc(STATS_RUNTIME, sizeof(JitRegion) * capacity);
+					}
+
+					jit->regions[jit->regions_length++] = (JitRegion){
+						program->code[start], start, i + 1, 0, false, NULL
+					};
+				}
+
+				pure = false;
+				break;
+			default: pure = false;
+		}
+
+		if (depth > max_depth) max_depth = depth;
+
+		if (!pure) {
+			start = i + 1;
+			depth = 0;
+			max_depth = 0;
+		}
+	}
+}
+
+Jit *new_jit(Program *program, JitMode mode) {
+#ifndef HAVE_JIT
+	(void)program;
+	(void)mode;
+	return NULL;
+#else
+	if (mode == JIT_OFF) return NULL;
+
+	Jit *jit = malloc(sizeof(Jit));
+	ensure_alloc(jit);
+	count_alloc(STATS_RUNTIME, sizeof(Jit));
+	*jit = (Jit){ program, NULL, NULL, 0, mode == JIT_ALWAYS ? 1 : JIT_HOT_THRESHOLD, NULL, 0, 0 };
+
+	find_regions(jit);
+
+	if (jit->regions_length == 0) {
+		free(jit);
+		return NULL;
+	}
+
+	// the program's own code may be a read only mapping of the cache, and it
+	// shouldn't have the entries in it anyway
+	jit->code = malloc(sizeof(Instruction) * program->length);
+	ensure_alloc(jit->code);
+	count_alloc(STATS_RUNTIME, sizeof(Instruction) * program->length);
+	memcpy(jit->code, program->code, sizeof(Instruction) * program->length);
+
+	for (size_t i = 0; i < jit->regions_length; i++)
+		jit->code[jit->regions[i].start] = (Instruction){ OP_JIT_ENTRY, i };
+
+	return jit;
+#endif
+}
+
+void free_jit(Jit *jit) {
+	if (jit == NULL) return;
+
+#ifdef HAVE_JIT
+	for (size_t i = 0; i < jit->blocks_length; i++)
+		munmap(jit->blocks[i], JIT_BLOCK_SIZE);
+#endif
+
+	free(jit->blocks);
+	free(jit->regions);
+	free(jit->code);
+	free(jit);
+}
+
+#ifndef HAVE_JIT
+
+void compile_region(Jit *jit, JitRegion *region) {
+	(void)jit;
+	region->failed = true;
+}
+
+#else
+
+// the machine code is written into a buffer first. the value on the stack at
+// depth d lives in xmm<d>, the variables pointer is kept in rbx and the
+// constants pointer in r12 (both saved by the callee, so they survive calls).
+// a numeric variable's value is just the bits of its double, so loads and
+// stores go straight to the slot
+
+#define RAX 0
+#define RBX 3
+#define RSP 4
+#define R12 12
+#define XMM_SCRATCH 15
+
+// mandatory prefixes for sse2 instructions
+#define SCALAR_DOUBLE 0xF2
+#define PACKED_DOUBLE 0x66
+
+#define MOVSD_LOAD 0x10
+#define MOVSD_STORE 0x11
+#define MOVAPD 0x28
+#define XORPD 0x57
+#define ADDSD 0x58
+#define MULSD 0x59
+#define SUBSD 0x5C
+#define DIVSD 0x5E
+
+// 8 bytes for each register that might need saving across a call, which also
+// keeps the stack 16 byte aligned once rbx and r12 have been pushed
+#define SPILL_AREA_SIZE (JIT_MAX_DEPTH * 8)
+
+// the most any one instruction can need, which is a call that saves and
+// restores every register
+#define MAX_INSTRUCTION_BYTES (2 * JIT_MAX_DEPTH * 10 + 64)
+
+typedef struct {
+	uint8_t *bytes;
+	size_t length;
+} Assembler;
+
+static inline void put_byte(Assembler *as, uint8_t byte) { as->bytes[as->length++] = byte; }
+
+static inline void put_u32(Assembler *as, uint32_t value) {
+	memcpy(as->bytes + as->length, &value, 4);
+	as->length += 4;
+}
+
+static inline void put_u64(Assembler *as, uint64_t value) {
+	memcpy(as->bytes + as->length, &value, 8);
+	as->length += 8;
+}
+
+// the rex prefix is only needed for registers 8 and up
+static inline void put_rex(Assembler *as, bool wide, int reg, int rm) {
+	uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+	if (rex != 0x40) put_byte(as, rex);
+}
+
+// an sse instruction between an xmm register and [base + displacement]
+static void sse_memory(Assembler *as, uint8_t prefix, uint8_t opcode, int xmm, int base, int32_t displacement) {
+	put_byte(as, prefix);
+	put_rex(as, false, xmm, base);
+	put_byte(as, 0x0F);
+	put_byte(as, opcode);
+	put_byte(as, 0x80 | ((xmm & 7) << 3) | (base & 7));
+	if ((base & 7) == RSP) put_byte(as, 0x24); // rsp and r12 need a sib byte
+	put_u32(as, displacement);
+}
+
+static void sse_registers(Assembler *as, uint8_t prefix, uint8_t opcode, int destination, int source) {
+	put_byte(as, prefix);
+	put_rex(as, false, destination, source);
+	put_byte(as, 0x0F);
+	put_byte(as, opcode);
+	put_byte(as, 0xC0 | ((destination & 7) << 3) | (source & 7));
+}
+
+static void move_xmm(Assembler *as, int destination, int source) {
+	if (destination != source) sse_registers(as, PACKED_DOUBLE, MOVAPD, destination, source);
+}
+
+static void mov_rax_immediate(Assembler *as, uint64_t value) {
+	put_byte(as, 0x48);
+	put_byte(as, 0xB8);
+	put_u64(as, value);
+}
+
+// calls a function on the arguments at the top of the stack, leaving its
+// result in place of them. every xmm register belongs to the caller, so the
+// ones below the arguments are saved first (before xmm0 gets overwritten)
+static void call_function(Assembler *as, void *function, int first_argument, int argument_count) {
+	for (int i = 0; i < first_argument; i++) sse_memory(as, SCALAR_DOUBLE, MOVSD_STORE, i, RSP, i * 8);
+
+	// xmm0 has to be filled before xmm1 in case the first argument is in xmm1
+	move_xmm(as, 0, first_argument);
+	if (argument_count == 2) move_xmm(as, 1, first_argument + 1);
+
+	mov_rax_immediate(as, (uint64_t)(uintptr_t)function);
+	put_byte(as, 0xFF); // call rax
+	put_byte(as, 0xD0);
+
+	move_xmm(as, first_argument, 0);
+	for (int i = 0; i < first_argument; i++) sse_memory(as, SCALAR_DOUBLE, MOVSD_LOAD, i, RSP, i * 8);
+}
+
+static bool assemble_region(Program *program, JitRegion *region, Assembler *as) {
+
+	put_byte(as, 0x53); // push rbx
+	put_byte(as, 0x41); // push r12
+	put_byte(as, 0x54);
+	put_byte(as, 0x48); // sub rsp, SPILL_AREA_SIZE
+	put_byte(as, 0x81);
+	put_byte(as, 0xEC);
+	put_u32(as, SPILL_AREA_SIZE);
+	put_byte(as, 0x48); // mov rbx, rdi
+	put_byte(as, 0x89);
+	put_byte(as, 0xFB);
+	put_byte(as, 0x49); // mov r12, rsi
+	put_byte(as, 0x89);
+	put_byte(as, 0xF4);
+
+	int depth = 0;
+
+	for (uint32_t i = region->start; i < region->end; i++) {
+		Instruction instruction = program->code[i];
+		uint64_t operand = instruction.operand;
+
+		switch (instruction.opcode) {
+			case OP_PUSH_NUMBER:
+				if (operand * sizeof(double) > INT32_MAX) return false;
+				sse_memory(as, SCALAR_DOUBLE, MOVSD_LOAD, depth++, R12, operand * sizeof(double));
+				break;
+			case OP_LOAD_VAR:
+				if (operand * sizeof(Value) > INT32_MAX) return false;
+				sse_memory(as, SCALAR_DOUBLE, MOVSD_LOAD, depth++, RBX, operand * sizeof(Value));
+				break;
+			case OP_STORE_VAR:
+				if (operand * sizeof(Value) > INT32_MAX) return false;
+				sse_memory(as, SCALAR_DOUBLE, MOVSD_STORE, --depth, RBX, operand * sizeof(Value));
+				break;
+			case OP_ADD: depth--; sse_registers(as, SCALAR_DOUBLE, ADDSD, depth - 1, depth); break;
+			case OP_SUBTRACT: depth--; sse_registers(as, SCALAR_DOUBLE, SUBSD, depth - 1, depth); break;
+			case OP_MULTIPLY: depth--; sse_registers(as, SCALAR_DOUBLE, MULSD, depth - 1, depth); break;
+			case OP_DIVIDE: depth--; sse_registers(as, SCALAR_DOUBLE, DIVSD, depth - 1, depth); break;
+			case OP_NEGATE:
+				// flipping the sign bit is exactly what the interpreter's - does
+				mov_rax_immediate(as, 0x8000000000000000ULL);
+				put_byte(as, 0x66); // movq xmm15, rax
+				put_byte(as, 0x4C);
+				put_byte(as, 0x0F);
+				put_byte(as, 0x6E);
+				put_byte(as, 0xF8);
+				sse_registers(as, PACKED_DOUBLE, XORPD, depth - 1, XMM_SCRATCH);
+				break;
+			case OP_POWER:
+				depth--;
+				call_function(as, (void *)pow, depth - 1, 2);
+				break;
+			case OP_CALL_BUILTIN:
+				call_function(as, (void *)builtins[operand].function, depth - 1, 1);
+				break;
+			default: return false;
+		}
+	}
+
+	put_byte(as, 0x48); // add rsp, SPILL_AREA_SIZE
+	put_byte(as, 0x81);
+	put_byte(as, 0xC4);
+	put_u32(as, SPILL_AREA_SIZE);
+	put_byte(as, 0x41); // pop r12
+	put_byte(as, 0x5C);
+	put_byte(as, 0x5B); // pop rbx
+	put_byte(as, 0xC3); // ret
+
+	return true;
+}
+
+// copies machine code into executable memory. blocks are only ever writable
+// or executable, never both at once
+static JitFunction install(Jit *jit, Assembler *as) {
+	if (as->length > JIT_BLOCK_SIZE) return NULL;
+
+	if (jit->blocks_length == 0 || jit->block_used + as->length > JIT_BLOCK_SIZE) {
+		void *block = mmap(NULL, JIT_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED) return NULL;
+		count_alloc(STATS_RUNTIME, JIT_BLOCK_SIZE);
+
+		jit->blocks = realloc(jit->blocks, sizeof(uint8_t *) * (jit->blocks_length + 1));
+		ensure_alloc(jit->blocks);
+		count_alloc(STATS_RUNTIME, sizeof(uint8_t *) * (jit->blocks_length + 1));
+		jit->blocks[jit->blocks_length++] = block;
+		jit->block_used = 0;
+	} else if (mprotect(jit->blocks[jit->blocks_length - 1], JIT_BLOCK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+		return NULL;
+	}
+
+	uint8_t *block = jit->blocks[jit->blocks_length - 1];
+	uint8_t *function = block + jit->block_used;
+	memcpy(function, as->bytes, as->length);
+
+	// keep functions 16 byte aligned
+	jit->block_used = (jit->block_used + as->length + 15) & ~(size_t)15;
+
+	if (mprotect(block, JIT_BLOCK_SIZE, PROT_READ | PROT_EXEC) != 0) return NULL;
+
+	return (JitFunction)(void *)function;
+}
+
+void compile_region(Jit *jit, JitRegion *region) {
+	Assembler as = { malloc(MAX_INSTRUCTION_BYTES * (region->end - region->start + 2)), 0 };
+	ensure_alloc(as.bytes);
+	count_alloc(STATS_RUNTIME, MAX_INSTRUCTION_BYTES * (region->end - region->start + 2));
+
+	if (assemble_region(jit->program, region, &as))
+		region->function = install(jit, &as);
+
+	region->failed = region->function == NULL;
+	free(as.bytes);
+}
+
+#endif // HAVE_JIT
@@ -0,0 +1,67 @@
+#ifndef INCLUDE_JIT_H
+#define INCLUDE_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "vm.h"
+
+// the jit turns numeric assignments (let x = <maths>) into sse2 machine code
+// once they've run enough times. it only knows how to write x86-64, so
+// everywhere else the vm just interprets everything
+#if defined(__x86_64__) && defined(__linux__)
+#define HAVE_JIT
+#endif
+
+typedef enum {
+	JIT_OFF,
+	JIT_ON, // compile an assignment once it's hot
+	JIT_ALWAYS // compile every assignment the first time it runs
+} JitMode;
+
+extern JitMode jit_mode;
+
+// how many times an assignment has to run before it's compiled
+#define JIT_HOT_THRESHOLD 64
+
+// each value on the vm's stack gets an xmm register, and xmm15 is kept free
+// for constants, so deeper expressions than this stay in the interpreter
+#define JIT_MAX_DEPTH 15
+
+typedef void (*JitFunction)(Value *variables, double *numbers);
+
+// an assignment's instructions, from the first push up to and including the
+// store. the first one is swapped for an OP_JIT_ENTRY in the jit's copy of
+// the code
+typedef struct {
+	Instruction first;
+	uint32_t start, end; // end is the instruction after the store
+	uint32_t hits;
+	bool failed; // couldn't be compiled, so don't try again
+	JitFunction function;
+} JitRegion;
+
+typedef struct {
+	Program *program;
+	Instruction *code; // the program's code with the entries patched in
+	JitRegion *regions;
+	size_t regions_length;
+	uint32_t threshold;
+
+	// the executable memory functions are written to
+	uint8_t **blocks;
+	size_t blocks_length;
+	size_t block_used;
+} Jit;
+
+// returns NULL if the jit is off or there's nothing in the program it can do
+extern Jit *new_jit(Program *program, JitMode mode);
+extern void free_jit(Jit *jit);
+
+// compiles a region to machine code, setting its function (or failed if it
+// can't be done)
+extern void compile_region(Jit *jit, JitRegion *region);
+
+#endif // INCLUDE_JIT_H
@@ -2,9 +2,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
 
 #include "lexer.h"
 #include "utils.h"
+#include "number.h"
+#include "scan.h"
+#include "stats.h"
 
 char *stringify_token_type(TokenType token_type) {
 	switch (token_type) {
@@ -20,26 +26,42 @@ char *stringify_token_type(TokenType token_type) {
 		case TOKEN_STRING: return "STRING";
 		case TOKEN_COMMA: return "COMMA";
 		case TOKEN_SEMICOLON: return "SEMICOLON";
+		case TOKEN_COMPARISON: return "COMPARISON";
+		case TOKEN_GOTO: return "GOTO";
+		case TOKEN_GOSUB: return "GOSUB";
+		case TOKEN_RETURN: return "RETURN";
+		case TOKEN_IF: return "IF";
+		case TOKEN_THEN: return "THEN";
+		case TOKEN_END: return "END";
+		case TOKEN_NEWLINE: return "NEWLINE";
 		case TOKEN_EOF: return "EOF";
 	}
 }
 
-void free_token_literal(Token token) {
-	if (token.string_literal != NULL)
-		free(token.string_literal);
-}
-
-Lexer *new_lexer(char *code, size_t buffer_capacity) {
+Lexer *new_lexer(char *code, size_t buffer_capacity, SymbolTable *symbols) {
 	Lexer *lexer = malloc(sizeof(Lexer));
 	ensure_alloc(lexer);
+	count_alloc(STATS_LEXER, sizeof(Lexer));
+
+	select_scanner();
 
 	lexer->code = code;
 	lexer->current_index = 0;
 	lexer->line = 1;
 	lexer->column_start = 0;
+	lexer->code_end = SIZE_MAX;
+	lexer->symbols = symbols;
+
+	lexer->input_fd = -1;
+	lexer->input_ended = true;
+	lexer->window_offset = 0;
+	lexer->window_length = 0;
+	lexer->window_capacity = 0;
+	lexer->line_end = 0;
 
 	Token *tokens = malloc(buffer_capacity * sizeof(Token));
 	ensure_alloc(tokens);
+	count_alloc(STATS_LEXER, buffer_capacity * sizeof(Token));
 
 	lexer->tokens = (TokenBuffer){
 		tokens,
@@ -52,14 +74,118 @@ Lexer *new_lexer(char *code, size_t buffer_capacity) {
 	return lexer;
 }
 
-void free_lexer(Lexer *lexer) {
-	// for (size_t i = 0; i < lexer->tokens.length; i++)
-	// 	free_token_literal(lexer->tokens.tokens[i]);
+Lexer *new_streaming_lexer(
+	int input_fd,
+	size_t window_capacity,
+	size_t buffer_capacity,
+	SymbolTable *symbols
+) {
+	// one extra byte for the null byte that marks the end of the window
+	char *window = malloc(window_capacity + 1);
+	ensure_alloc(window);
+	count_alloc(STATS_LEXER, window_capacity + 1);
+	window[0] = '\0';
+
+	Lexer *lexer = new_lexer(window, buffer_capacity, symbols);
+	lexer->input_fd = input_fd;
+	lexer->input_ended = false;
+	lexer->window_capacity = window_capacity;
+
+	return lexer;
+}
 
+void free_lexer(Lexer *lexer) {
+	if (lexer_is_streaming(lexer)) free(lexer->code);
 	free(lexer->tokens.tokens);
 	free(lexer);
 }
 
+// moves whatever is still needed to the front of the window and reads more
+// input after it until there's a newline (or the input ends)
+void refill_window(Lexer *lexer) {
+	// keep the current line as well as any tokens that are still buffered, since
+	// the parser may want their text
+	size_t keep_from = lexer->column_start - lexer->window_offset;
+	TokenBuffer *buffer = &lexer->tokens;
+
+	for (size_t i = 0; i < buffer->length; i++) {
+		size_t token_start = buffer->tokens[i].start - lexer->window_offset;
+		if (token_start < keep_from) keep_from = token_start;
+	}
+
+	memmove(lexer->code, lexer->code + keep_from, lexer->window_length - keep_from);
+	lexer->window_length -= keep_from;
+	lexer->current_index -= keep_from;
+	lexer->window_offset += keep_from;
+	lexer->line_end = 0;
+
+	while (!lexer->input_ended) {
+		// a line that doesn't fit in the window is the only thing that makes it grow
+		if (lexer->window_length == lexer->window_capacity) {
+			lexer->window_capacity *= 2;
+			lexer->code = realloc(lexer->code, lexer->window_capacity + 1);
+			ensure_alloc(lexer->code);
+			count_alloc(STATS_LEXER, lexer->window_capacity + 1);
+		}
+
+		char *read_start = lexer->code + lexer->window_length;
+		ssize_t amount_read = read(
+			lexer->input_fd, read_start, lexer->window_capacity - lexer->window_length
+		);
+
+		if (amount_read < 0) {
+			if (errno == EINTR) continue;
+			printf("Error: could not read input\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (amount_read == 0) lexer->input_ended = true;
+		lexer->window_length += amount_read;
+
+		// find the last newline in what was just read
+		for (ssize_t i = amount_read - 1; i >= 0; i--) {
+			if (read_start[i] == '\n') {
+				lexer->line_end = read_start + i + 1 - lexer->code;
+				break;
+			}
+		}
+
+		if (lexer->line_end > lexer->current_index) break;
+	}
+
+	lexer->code[lexer->window_length] = '\0';
+}
+
+char *token_text(Lexer *lexer, Token token) {
+	return lexer->code + (token.start - lexer->window_offset);
+}
+
+StringSlice token_string_value(Lexer *lexer, Token token, Arena *arena) {
+	char *text = token_text(lexer, token);
+	if (!token.has_escapes && !lexer_is_streaming(lexer)) return (StringSlice){ text, token.length };
+
+	// the result can only be shorter than the text since escapes take two chars
+	char *string = arena_alloc(arena, token.length + 1);
+	size_t length = 0;
+
+	for (size_t i = 0; i < token.length; i++) {
+		char ch = text[i];
+
+		if (ch == '\\') {
+			char escaped_char = text[++i];
+			switch (escaped_char) {
+				case 'n': ch = '\n'; break;
+				case 't': ch = '\t'; break;
+				default: ch = escaped_char; // covers \" and \\ too
+			}
+		}
+
+		string[length++] = ch;
+	}
+
+	return (StringSlice){ string, length };
+}
+
 Token *get_most_recent_token(Lexer *lexer) {
 	TokenBuffer buffer = lexer->tokens;
 	if (buffer.length == 0) return NULL;
@@ -70,12 +196,38 @@ Token *get_most_recent_token(Lexer *lexer) {
 inline char peek(Lexer *lexer) { return lexer->code[lexer->current_index]; }
 inline char consume(Lexer *lexer) { return lexer->code[lexer->current_index++]; }
 
-bool case_insensitive_match(Lexer *lexer, char *str) {
-	for (size_t i = 0; i < strlen(str); i++)
-		if (tolower(lexer->code[lexer->current_index + i]) != tolower(str[i]))
-			return false;
+// keywords are found with a perfect hash of their length and first and last
+// chars, so recognising one costs the same however many keywords there are.
+// if a new keyword collides with an existing one then the multipliers in
+// hash_keyword need changing
+#define KEYWORD_SLOTS 16
+
+static const Keyword keywords[KEYWORD_SLOTS] = {
+	[0] = { "rem", 3, TOKEN_EOF, true },
+	[1] = { "gosub", 5, TOKEN_GOSUB, false },
+	[2] = { "let", 3, TOKEN_LET, false },
+	[7] = { "goto", 4, TOKEN_GOTO, false },
+	[10] = { "print", 5, TOKEN_PRINT, false },
+	[11] = { "end", 3, TOKEN_END, false },
+	[12] = { "then", 4, TOKEN_THEN, false },
+	[13] = { "if", 2, TOKEN_IF, false },
+	[14] = { "return", 6, TOKEN_RETURN, false }
+};
+
+static inline size_t hash_keyword(char *name, size_t length) {
+	return (length * 2 + tolower(name[0]) + tolower(name[length - 1]) * 8) & (KEYWORD_SLOTS - 1);
+}
 
-	return true;
+const Keyword *lookup_keyword(char *name, size_t length) {
+	const Keyword *keyword = &keywords[hash_keyword(name, length)];
+
+	if (keyword->length != length) return NULL;
+
+	for (size_t i = 0; i < length; i++)
+		if (tolower(name[i]) != keyword->name[i])
+			return NULL;
+
+	return keyword;
 }
 
 inline bool valid_variable_char(Lexer *lexer) {
@@ -84,32 +236,48 @@ inline bool valid_variable_char(Lexer *lexer) {
 }
 
 TokenResult _get_next_token(Lexer *lexer) {
+	// tokens never span lines, so as long as the rest of the line is in the
+	// window there's no need to check for the end of it while lexing
+	if (lexer_is_streaming(lexer) && lexer->current_index >= lexer->line_end && !lexer->input_ended)
+		refill_window(lexer);
+
+	// a lexer over part of the code stops straight after a newline, so there's
+	// nothing to skip before checking if it's there yet
+	if (lexer->current_index >= lexer->code_end)
+		return (TokenResult){ true, { .token = {
+			TOKEN_EOF, lexer->current_index, 0, .line = lexer->line, .column = 1
+		} } };
+
 	// consume whitespace
-	while (peek(lexer) == ' ' || peek(lexer) == '\t') consume(lexer);
+	lexer->current_index = scanner->skip_whitespace(lexer->code, lexer->current_index);
 
-	// consume comments
-	if (peek(lexer) == '\'' || case_insensitive_match(lexer, "rem"))
-		while (peek(lexer) != '\n')
-			consume(lexer);
+	// consume comments (but leave the newline so it still ends the statement)
+	if (peek(lexer) == '\'')
+		lexer->current_index = scanner->find_line_end(lexer->code, lexer->current_index);
 
+	// line, column and position of token that's about to be determined
+	size_t s = lexer->window_offset + lexer->current_index;
+	size_t l = lexer->line;
+	size_t c = s - lexer->column_start + 1;
+
+	// newlines separate statements so they get a token of their own
 	if (peek(lexer) == '\n') {
 		consume(lexer);
 		lexer->line++;
-		lexer->column_start = lexer->current_index;
+		lexer->column_start = s + 1;
+		return (TokenResult){ true, { .token = {
+			TOKEN_NEWLINE, s, 1, .char_literal = '\n', .line = l, .column = c
+		} } };
 	}
 
-	// line and column of token that's about to be determined
-	size_t l = lexer->line;
-	size_t c = lexer->current_index - lexer->column_start + 1;
-
 	// single char tokens
 
 	#define single_char_token(token_type) (TokenResult){ \
-		true, { .token = { token_type, NULL, consume(lexer), .line = l, .column = c } } \
+		true, { .token = { token_type, s, 1, .char_literal = consume(lexer), .line = l, .column = c } } \
 	}
 
 	switch (peek(lexer)) {
-		case '\0': return (TokenResult){ true, { .token = { TOKEN_EOF, .line = l, .column = c } } };
+		case '\0': return (TokenResult){ true, { .token = { TOKEN_EOF, s, 0, .line = l, .column = c } } };
 		case '+':
 		case '*':
 		case '/':
@@ -129,25 +297,26 @@ TokenResult _get_next_token(Lexer *lexer) {
 		case ')': return single_char_token(TOKEN_CLOSE_PAREN);
 		case ',': return single_char_token(TOKEN_COMMA);
 		case ';': return single_char_token(TOKEN_SEMICOLON);
-	}
+		case '<':
+		case '>': {
+			char first = consume(lexer);
+			char op = first;
 
-	// keywords
+			if (peek(lexer) == '=') op = first == '<' ? COMPARE_LESS_EQUAL : COMPARE_GREATER_EQUAL;
+			else if (first == '<' && peek(lexer) == '>') op = COMPARE_NOT_EQUAL;
 
-	#define match_keyword_token(keyword, token_type) \
-		if (case_insensitive_match(lexer, keyword)) { \
-			lexer->current_index += strlen(keyword); \
-			return (TokenResult){ true, { .token = { token_type, .line = l, .column = c } } }; \
-		}
+			if (op != first) consume(lexer);
 
-	match_keyword_token("let", TOKEN_LET)
-	match_keyword_token("print", TOKEN_PRINT)
+			return (TokenResult){ true, { .token = {
+				TOKEN_COMPARISON, s, op == first ? 1 : 2, .char_literal = op, .line = l, .column = c
+			} } };
+		}
+	}
 
 	// numbers
 
-	while (peek(lexer) == '0') consume(lexer); // consume leading zeros
-
 	if (isdigit(peek(lexer)) || peek(lexer) == '.') {
-		BufferedString num_as_str = empty_buffered_string(4);
+		size_t start = lexer->current_index;
 		bool has_decimal = false;
 
 		for (size_t i = 0; isdigit(peek(lexer)) || peek(lexer) == '.'; i++) {
@@ -161,58 +330,79 @@ TokenResult _get_next_token(Lexer *lexer) {
 				else
 					has_decimal = true;
 			}
-
-			buffered_string_append_char(&num_as_str, ch);
 		}
 
-		return (TokenResult){ true, { .token = { TOKEN_NUMBER, num_as_str.buffer, '\0', l, c } } };
+		// convert the number straight away so it never has to be parsed again
+		size_t length = lexer->current_index - start;
+		double number = decimal_to_double(lexer->code + start, length);
+		return (TokenResult){ true, { .token = {
+			TOKEN_NUMBER, s, length, .number_literal = number, .line = l, .column = c
+		} } };
 	}
 
 	// strings
 
 	if (peek(lexer) == '"') {
 		consume(lexer); // consume opening quotes
-		BufferedString string = empty_buffered_string(8);
+		size_t start = lexer->current_index;
+		bool has_escapes = false;
 
-		while (peek(lexer) != '"') {
+		while (true) {
+			// jump straight to the next char that could end the string or start an escape
+			lexer->current_index = scanner->find_string_end(lexer->code, lexer->current_index);
 			char ch = peek(lexer);
 
+			if (ch == '"') break;
+
 			// if string ends early without quotes
 			if (ch == '\0' || ch == '\n') {
-				free(string.buffer);
 				return (TokenResult){ false, { .error = {
 					"Expected closing double quotes to match the opening ones",
-					l, c, lexer->current_index - lexer->column_start + 1
+					l, c, lexer->window_offset + lexer->current_index - lexer->column_start + 1
 				} } };
 			}
 
+			// escapes are only processed if the parser asks for the string's value
 			if (ch == '\\') {
+				has_escapes = true;
 				consume(lexer); // consume backslash
-				char escaped_char = peek(lexer);
-				switch (escaped_char) {
-					case 'n': ch = '\n'; break;
-					case 't': ch = '\t'; break;
-					case '"': ch = '"'; break;
-					case '\\': ch = '\\'; break;
-					default: ch = escaped_char;
-				}
+				if (peek(lexer) == '\0' || peek(lexer) == '\n') continue;
+				consume(lexer); // consume escaped char
 			}
-
-			buffered_string_append_char(&string, ch);
-			consume(lexer);
 		}
 
+		size_t length = lexer->current_index - start;
 		consume(lexer); // consume closing quotes
-		return (TokenResult){ true, { .token = { TOKEN_STRING, string.buffer, '\0', l, c } } };
+
+		return (TokenResult){ true, { .token = {
+			TOKEN_STRING, s + 1, length, has_escapes, .line = l, .column = c
+		} } };
 	}
 
-	// names (vars/functions)
+	// names (vars/functions) and keywords
 
 	if (valid_variable_char(lexer)) {
-		BufferedString name = empty_buffered_string(4);
-		while (valid_variable_char(lexer))
-			buffered_string_append_char(&name, consume(lexer));
-		return (TokenResult){ true, { .token = { TOKEN_NAME, name.buffer, '\0', l, c } } };
+		size_t start = lexer->current_index;
+		while (valid_variable_char(lexer)) consume(lexer);
+
+		size_t length = lexer->current_index - start;
+
+		// keywords have to be a whole word, so names like letter are left alone
+		const Keyword *keyword = lookup_keyword(lexer->code + start, length);
+
+		if (keyword != NULL && keyword->starts_comment) {
+			lexer->current_index = scanner->find_line_end(lexer->code, lexer->current_index);
+			return _get_next_token(lexer);
+		}
+
+		if (keyword != NULL)
+			return (TokenResult){ true, { .token = { keyword->type, s, length, .line = l, .column = c } } };
+
+		Symbol symbol = intern_symbol(lexer->symbols, lexer->code + start, length);
+
+		return (TokenResult){ true, { .token = {
+			TOKEN_NAME, s, length, .symbol = symbol, .line = l, .column = c
+		} } };
 	}
 
 	return (TokenResult){ false, { .error = { "Invalid token", l, c, -1 } } };
@@ -227,24 +417,32 @@ void _write_token_result(Lexer *lexer, TokenResult token_result, size_t index) {
 		if (buffer->length < buffer->capacity)
 			buffer->length++;
 
-		buffer->tokens[index].type = token.type;
-		buffer->tokens[index].string_literal = token.string_literal;
-		buffer->tokens[index].char_literal = token.char_literal;
-		buffer->tokens[index].line = token.line;
-		buffer->tokens[index].column = token.column;
+		buffer->tokens[index] = token;
 	}
 }
 
+void skip_rest_of_line(Lexer *lexer) {
+	lexer->tokens.peeked = false;
+	lexer->current_index = scanner->find_line_end(lexer->code, lexer->current_index);
+}
+
 TokenResult peek_token(Lexer *lexer) {
 	// if we have already peeked at the next token, return that
 	if (lexer->tokens.peeked) return (TokenResult){ true, {
 		.token = lexer->tokens.tokens[lexer->tokens.next_index]
 	} };
 
+	size_t start = lexer->window_offset + lexer->current_index;
 	TokenResult token_result = _get_next_token(lexer);
 
+	// go back to where the token started if it failed so that lexing it again
+	// gives the same error instead of carrying on from the middle of it
+	if (!token_result.success) lexer->current_index = start - lexer->window_offset;
+
+	// only remember successful tokens, otherwise the next call would hand back
+	// whatever was left over in the buffer
 	_write_token_result(lexer, token_result, lexer->tokens.next_index);
-	lexer->tokens.peeked = true;
+	lexer->tokens.peeked = token_result.success;
 
 	return token_result;
 }
@@ -258,7 +456,9 @@ TokenResult next_token(Lexer *lexer) {
 		} };
 		lexer->tokens.peeked = false;
 	} else {
+		size_t start = lexer->window_offset + lexer->current_index;
 		token_result = _get_next_token(lexer);
+		if (!token_result.success) lexer->current_index = start - lexer->window_offset;
 		_write_token_result(lexer, token_result, lexer->tokens.next_index);
 	}
 
@@ -267,3 +467,171 @@ TokenResult next_token(Lexer *lexer) {
 
 	return token_result;
 }
+
+// code in memory is lexed in one go unless offsets would get too big to fit
+// in 32 bits, in which case it's lexed this much at a time instead
+#define STREAM_BATCH_SIZE ((size_t)1 << 31)
+
+// grows an array to fit at least one more element, doubling its capacity
+static void *grow(void *array, size_t *capacity, size_t length, size_t element_size) {
+	if (length < *capacity) return array;
+
+	*capacity = *capacity == 0 ? 16 : *capacity * 2;
+	array = realloc(array, *capacity * element_size);
+	ensure_alloc(array);
+	count_alloc(STATS_LEXER, *capacity * element_size);
+
+	return array;
+}
+
+static void push_line_start(TokenStream *stream, size_t offset) {
+	stream->line_starts = grow(stream->line_starts, &stream->lines_capacity, stream->lines_length, sizeof(uint32_t));
+	stream->line_starts[stream->lines_length++] = offset - stream->base_offset;
+}
+
+TokenStream new_token_stream(Lexer *lexer) {
+	TokenStream stream = { 0 };
+	stream.lexer = lexer;
+	stream.first_line = lexer->line;
+	stream.base_offset = lexer->column_start;
+	push_line_start(&stream, lexer->column_start);
+	return stream;
+}
+
+void free_token_stream(TokenStream *stream) {
+	free(stream->types);
+	free(stream->offsets);
+	free(stream->literals);
+	free(stream->numbers);
+	free(stream->strings);
+	free(stream->errors);
+	free(stream->line_starts);
+	free_lexer(stream->lexer);
+}
+
+void reset_token_stream(TokenStream *stream) {
+	stream->length = 0;
+	stream->numbers_length = 0;
+	stream->strings_length = 0;
+	stream->errors_length = 0;
+	stream->lines_length = 0;
+	stream->first_line = stream->lexer->line;
+	stream->base_offset = stream->lexer->column_start;
+	push_line_start(stream, stream->lexer->column_start);
+}
+
+static inline void push_token(TokenStream *stream, uint8_t type, size_t offset, uint32_t literal) {
+	if (stream->length == stream->capacity) {
+		stream->capacity = stream->capacity == 0 ? 1024 : stream->capacity * 2;
+		stream->types = realloc(stream->types, stream->capacity);
+		stream->offsets = realloc(stream->offsets, sizeof(uint32_t) * stream->capacity);
+		stream->literals = realloc(stream->literals, sizeof(uint32_t) * stream->capacity);
+		ensure_alloc(stream->types);
+		ensure_alloc(stream->offsets);
+		ensure_alloc(stream->literals);
+		count_alloc(STATS_LEXER, (1 + sizeof(uint32_t) * 2) * stream->capacity);
+	}
+
+	stream->types[stream->length] = type;
+	stream->offsets[stream->length] = offset - stream->base_offset;
+	stream->literals[stream->length] = literal;
+	stream->length++;
+}
+
+bool lex_more_tokens(TokenStream *stream) {
+	if (stream->complete) return false;
+
+	double start = start_phase();
+	Lexer *lexer = stream->lexer;
+	size_t first = stream->length;
+
+	while (true) {
+		size_t offset = lexer->window_offset + lexer->current_index;
+		TokenResult token_result = _get_next_token(lexer);
+
+		// the rest of the line can't be lexed, so the parser gets the error
+		// and then the newline
+		if (!token_result.success) {
+			stream->errors = grow(stream->errors, &stream->errors_capacity, stream->errors_length, sizeof(Error));
+			stream->errors[stream->errors_length] = token_result.result.error;
+			push_token(stream, TOKEN_ERROR, offset, stream->errors_length++);
+			skip_rest_of_line(lexer);
+			continue;
+		}
+
+		// the lexer only looks back at the type of the last token (to tell which
+		// kind of - it's lexing) and where it starts (so refilling the window
+		// keeps it), so that's all that needs remembering
+		Token token = token_result.result.token;
+		lexer->tokens.tokens[0].type = token.type;
+		lexer->tokens.tokens[0].start = token.start;
+		lexer->tokens.length = 1;
+		uint32_t literal = 0;
+
+		switch (token.type) {
+			case TOKEN_NAME: literal = token.symbol; break;
+			case TOKEN_NUMBER:
+				stream->numbers = grow(stream->numbers, &stream->numbers_capacity, stream->numbers_length, sizeof(double));
+				stream->numbers[stream->numbers_length] = token.number_literal;
+				literal = stream->numbers_length++;
+				break;
+			case TOKEN_STRING:
+				stream->strings = grow(
+					stream->strings, &stream->strings_capacity, stream->strings_length, sizeof(StringToken)
+				);
+				stream->strings[stream->strings_length] = (StringToken){ token.length, token.has_escapes };
+				literal = stream->strings_length++;
+				token.start--; // back to the opening quote
+				break;
+			case TOKEN_BINARY_OP:
+			case TOKEN_UNARY_OP:
+			case TOKEN_ASSIGN:
+			case TOKEN_COMPARISON:
+			case TOKEN_OPEN_PAREN:
+			case TOKEN_CLOSE_PAREN:
+			case TOKEN_COMMA:
+			case TOKEN_SEMICOLON:
+			case TOKEN_NEWLINE: literal = (uint8_t)token.char_literal; break;
+			default: break;
+		}
+
+		push_token(stream, token.type, token.start, literal);
+
+		if (token.type == TOKEN_EOF) {
+			stream->complete = true;
+			break;
+		}
+
+		if (token.type == TOKEN_NEWLINE) {
+			push_line_start(stream, token.start + 1);
+			if (lexer_is_streaming(lexer) || token.start - stream->base_offset >= STREAM_BATCH_SIZE) break;
+		}
+	}
+
+	count_token_types(stream->types + first, stream->length - first);
+	end_phase(PHASE_LEX, start);
+	return true;
+}
+
+TokenPosition token_position(TokenStream *stream, size_t index) {
+	uint32_t offset = stream->offsets[index];
+
+	// the last line that starts at or before the token
+	size_t low = 0, high = stream->lines_length;
+	while (high - low > 1) {
+		size_t middle = low + (high - low) / 2;
+		if (stream->line_starts[middle] <= offset) low = middle;
+		else high = middle;
+	}
+
+	return (TokenPosition){ stream->first_line + low, offset - stream->line_starts[low] + 1 };
+}
+
+StringSlice stream_string_value(TokenStream *stream, size_t index, Arena *arena) {
+	StringToken string = stream->strings[stream->literals[index]];
+	Token token = {
+		.type = TOKEN_STRING, .start = stream->base_offset + stream->offsets[index] + 1,
+		.length = string.length, .has_escapes = string.has_escapes
+	};
+	return token_string_value(stream->lexer, token, arena);
+}
@@ -2,8 +2,13 @@
 #define INCLUDE_LEXER_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+#include "arena.h"
+#include "utils.h"
+#include "symbols.h"
+
 typedef enum {
 	TOKEN_LET,
 	TOKEN_NAME,
@@ -17,19 +22,49 @@ typedef enum {
 	TOKEN_STRING,
 	TOKEN_COMMA,
 	TOKEN_SEMICOLON,
+	TOKEN_COMPARISON,
+	TOKEN_GOTO,
+	TOKEN_GOSUB,
+	TOKEN_RETURN,
+	TOKEN_IF,
+	TOKEN_THEN,
+	TOKEN_END,
+	TOKEN_NEWLINE,
 	TOKEN_EOF
 } TokenType;
 
+#define TOKEN_TYPES (TOKEN_EOF + 1)
+
 extern char *stringify_token_type(TokenType token_type);
 
+// comparisons that are two chars long get a char of their own in char_literal
+// (and in the op of the expression they end up in). = is lexed as an ASSIGN
+// and only becomes a comparison once it's inside an expression
+#define COMPARE_LESS_EQUAL 'L'
+#define COMPARE_GREATER_EQUAL 'G'
+#define COMPARE_NOT_EQUAL 'N'
+
+// names, numbers and strings don't copy their text out of the code, they just
+// remember where it is (for strings this excludes the quotes)
 typedef struct {
 	TokenType type;
-	char *string_literal;
+	size_t start, length;
+	bool has_escapes;
 	char char_literal;
+	double number_literal;
+	Symbol symbol; // names are interned as soon as they're lexed
 	size_t line, column;
 } Token;
 
-extern void free_token_literal(Token token);
+typedef struct {
+	char *name; // lowercase
+	size_t length;
+	TokenType type;
+	bool starts_comment; // for REM, which doesn't produce a token
+} Keyword;
+
+// returns the keyword which name is (ignoring case), or NULL if it isn't one
+extern const Keyword *lookup_keyword(char *name, size_t length);
 
 typedef struct {
 	char *message;
@@ -52,20 +87,52 @@ typedef struct {
 	bool peeked;
 } TokenBuffer;
 
+// when streaming, code is a window onto the input which gets refilled so that
+// it always holds the whole of the line being lexed. positions in tokens are
+// offsets into the whole input, so window_offset has to be taken off them to
+// index code (it's always 0 when the code is all in memory)
 typedef struct {
 	char *code;
 	size_t current_index;
 	size_t line;
-	size_t column_start; // index in code of first char in current column
+	size_t column_start; // offset in the input of the first char in the current line
+	size_t code_end; // lexing stops here (SIZE_MAX to carry on until the null byte)
 	TokenBuffer tokens;
+	SymbolTable *symbols;
+
+	int input_fd; // -1 unless streaming
+	bool input_ended;
+	size_t window_offset;
+	size_t window_length;
+	size_t window_capacity;
+	size_t line_end; // index after the last newline in the window
 } Lexer;
 
-extern Lexer *new_lexer(char *code, size_t buffer_capacity);
+#define STREAM_WINDOW_SIZE (64 * 1024)
+
+extern Lexer *new_lexer(char *code, size_t buffer_capacity, SymbolTable *symbols);
+extern Lexer *new_streaming_lexer(
+	int input_fd,
+	size_t window_capacity,
+	size_t buffer_capacity,
+	SymbolTable *symbols
+);
 extern void free_lexer(Lexer *lexer);
 
+static inline bool lexer_is_streaming(Lexer *lexer) {
+	return lexer->input_fd != -1;
+}
+
+extern void refill_window(Lexer *lexer);
+
+extern char *token_text(Lexer *lexer, Token token);
+
+// the value of a string token, only copied (into the arena) if it has escapes
+// or if the window it points into is going to move
+extern StringSlice token_string_value(Lexer *lexer, Token token, Arena *arena);
+
 extern inline char peek(Lexer *lexer);
 extern inline char consume(Lexer *lexer);
-extern bool case_insensitive_match(Lexer *lexer, char *str);
 extern inline bool valid_variable_char(Lexer *lexer);
 
 // this is where the actual tokenising happens
@@ -78,10 +145,90 @@ extern void _write_token_result(
 	size_t index
 );
 
-// these are the functions that will be used in the parser (these are the ones
-// which actually interact with the token buffer)
+// lexes a token at a time through the token buffer, for anything that only
+// needs to look one token ahead (the parser uses a TokenStream instead)
 extern TokenResult peek_token(Lexer *lexer);
 extern TokenResult next_token(Lexer *lexer);
 extern Token *get_most_recent_token(Lexer *lexer);
 
+// moves up to the newline at the end of the current line, dropping any peeked
+// token, so the parser can give up on the rest of a line
+extern void skip_rest_of_line(Lexer *lexer);
+
+// the type of a token that didn't lex. it only shows up in a TokenStream,
+// where the error is kept in errors
+#define TOKEN_ERROR TOKEN_TYPES
+
+typedef struct {
+	uint32_t length;
+	bool has_escapes;
+} StringToken;
+
+// tokens lexed ahead of the parser into a structure of arrays, so it can look
+// as far ahead as it likes by indexing them. code in memory is lexed in one
+// pass before parsing starts. a streamed program is lexed a line at a time,
+// and the stream is emptied between lines (by reset_token_stream) so it never
+// holds more than the line being parsed
+typedef struct {
+	uint8_t *types;
+	uint32_t *offsets; // from base_offset (for a string this is its opening quote)
+
+	// what literals holds depends on the type: the symbol of a name, the
+	// char_literal of an operator or anything else one char long, or an index
+	// into numbers, strings or errors. it's 0 for keywords and the EOF
+	uint32_t *literals;
+	size_t length, capacity;
+
+	double *numbers;
+	size_t numbers_length, numbers_capacity;
+	StringToken *strings;
+	size_t strings_length, strings_capacity;
+	Error *errors;
+	size_t errors_length, errors_capacity;
+
+	// where each line starts (from base_offset), so lines and columns only
+	// have to be worked out for the tokens an error is reported at
+	uint32_t *line_starts;
+	size_t lines_length, lines_capacity;
+	size_t first_line; // the line number of line_starts[0]
+	size_t base_offset;
+
+	Lexer *lexer;
+	bool complete; // whether the EOF has been lexed
+} TokenStream;
+
+typedef struct {
+	size_t line, column;
+} TokenPosition;
+
+// the stream takes ownership of the lexer, which should have a token buffer
+// with room for one token (to tell a binary - from a unary one)
+extern TokenStream new_token_stream(Lexer *lexer);
+extern void free_token_stream(TokenStream *stream);
+
+// lexes more of the input onto the end of the stream: the whole of it if it's
+// in memory, otherwise the next line. returns false once there's nothing left
+extern bool lex_more_tokens(TokenStream *stream);
+
+// forgets every token in the stream, so lexing carries on from an empty one.
+// only call this once the lexer is at the start of a line
+extern void reset_token_stream(TokenStream *stream);
+
+extern TokenPosition token_position(TokenStream *stream, size_t index);
+
+// the value of a string token, like token_string_value
+extern StringSlice stream_string_value(TokenStream *stream, size_t index, Arena *arena);
+
+static inline double token_number(TokenStream *stream, size_t index) {
+	return stream->numbers[stream->literals[index]];
+}
+
+static inline Symbol token_symbol(TokenStream *stream, size_t index) {
+	return stream->literals[index];
+}
+
+static inline char token_char(TokenStream *stream, size_t index) {
+	return (char)stream->literals[index];
+}
+
 #endif // INCLUDE_LEXER_H
@@ -2,29 +2,228 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "utils.h"
 #include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include "optimiser.h"
+#include "debug.h"
+#include "parallel.h"
+#include "workers.h"
+#include "cache.h"
+#include "check.h"
+#include "jit.h"
+#include "profile.h"
+#include "stats.h"
+
+typedef struct {
+	char *filename;
+	bool dump_optimized;
+	size_t thread_count;
+	bool use_cache;
+	bool cache_stats;
+	bool check;
+	bool profile;
+	char *folded_path; // where to write the profile's folded stacks, if anywhere
+} Options;
+
+static void report_errors(ErrorList errors, char *code) {
+	for (size_t i = 0; i < errors.length; i++)
+		print_error(stdout, errors.errors[i], code);
+
+	if (errors.truncated)
+		printf("Stopped after %zu errors (use --max-errors to change this)\n", max_errors);
+
+	free_error_list(errors);
+}
+
+// parses, optimises and compiles the program. returns false if it shouldn't be
+// run, either because it had errors or because it was only being dumped, with
+// the status to exit with in status
+static bool build_program(SourceFile source, bool streaming, Options *options, Program *program, int *status) {
+	ParserResult parser_result = streaming
+		? parse_stream(STDIN_FILENO, STREAM_WINDOW_SIZE)
+		: parse_parallel(source.code, source.length, options->thread_count);
+
+	if (!parser_result.success) {
+		report_errors(parser_result.result.errors, source.code);
+		*status = EXIT_FAILURE;
+		return false;
+	}
+
+	AST ast = parser_result.result.ast;
+	optimise_ast(&ast);
+
+	if (options->dump_optimized) {
+		print_ast(&ast);
+		free_ast(ast);
+		*status = EXIT_SUCCESS;
+		return false;
+	}
+
+	CompileResult compile_result = compile(ast);
+	free_ast(ast);
+
+	if (!compile_result.success) {
+		report_errors(compile_result.result.errors, source.code);
+		*status = EXIT_FAILURE;
+		return false;
+	}
+
+	*program = compile_result.result.program;
+	return true;
+}
+
+static void print_run_stats(void) {
+	if (!stats_enabled) return;
+
+	Stats stats = read_stats();
+	print_stats(stderr, &stats);
+}
 
 int main(int argc, char *argv[]) {
-	if (argc > 2) {
-		printf("Warning: extraneous arguments will be ignored\n");
-	} else if (argc == 1) {
-		printf("Usage: basic [filename]\n");
+	Options options = { NULL, false, default_thread_count(), true, false, false, false, NULL };
+
+	// in check mode every argument that isn't an option is a path to check
+	char **paths = malloc(sizeof(char *) * argc);
+	ensure_alloc(paths);
+	size_t path_count = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--dump-optimized") == 0)
+			options.dump_optimized = true;
+		else if (strncmp(argv[i], "--threads=", 10) == 0)
+			options.thread_count = strtoul(argv[i] + 10, NULL, 10);
+		else if (strcmp(argv[i], "--no-cache") == 0)
+			options.use_cache = false;
+		else if (strcmp(argv[i], "--cache-stats") == 0)
+			options.cache_stats = true;
+		else if (strcmp(argv[i], "--check") == 0)
+			options.check = true;
+		else if (strncmp(argv[i], "--max-errors=", 13) == 0)
+			max_errors = strtoul(argv[i] + 13, NULL, 10);
+		else if (strncmp(argv[i], "--max-depth=", 12) == 0)
+			max_depth = strtoul(argv[i] + 12, NULL, 10);
+		else if (strcmp(argv[i], "--profile") == 0)
+			options.profile = true;
+		else if (strncmp(argv[i], "--profile-folded=", 17) == 0) {
+			options.profile = true;
+			options.folded_path = argv[i] + 17;
+		} else if (strcmp(argv[i], "--jit=off") == 0)
+			jit_mode = JIT_OFF;
+		else if (strcmp(argv[i], "--jit=on") == 0)
+			jit_mode = JIT_ON;
+		else if (strcmp(argv[i], "--jit=always") == 0)
+			jit_mode = JIT_ALWAYS;
+		else if (strcmp(argv[i], "--stats") == 0)
+			stats_enabled = true;
+		else if (strncmp(argv[i], "--", 2) == 0)
+			printf("Warning: unknown option %s will be ignored\n", argv[i]);
+		else
+			paths[path_count++] = argv[i];
+	}
+
+	if (options.check && path_count > 0) {
+		int status = check_paths(paths, path_count, options.thread_count);
+		free(paths);
+		print_run_stats();
+		return status;
+	}
+
+	if (path_count > 0) options.filename = paths[0];
+	for (size_t i = 1; i < path_count; i++)
+		printf("Warning: extraneous argument %s will be ignored\n", paths[i]);
+	free(paths);
+
+	if (options.filename == NULL) {
+		printf("Usage: basic [options] [filename]\n");
+		printf("       basic [options] - (read the program from stdin)\n");
+		printf("       basic --check [options] paths... (parse files and directories without running them)\n");
+		printf("Options:\n");
+		printf("  --dump-optimized  print the program after optimising instead of running it\n");
+		printf("  --threads=N       parse large files (or check files) on N threads (defaults to one per cpu)\n");
+		printf("  --no-cache        don't read or write the compiled program cache (file.basc)\n");
+		printf("  --cache-stats     say whether the cache was used and how long each step took\n");
+		printf("  --max-errors=N    stop after finding N syntax errors (default %d, 0 for no limit)\n", DEFAULT_MAX_ERRORS);
+		printf("  --max-depth=N     allow expressions to be nested N deep (default %d, 0 for no limit)\n", DEFAULT_MAX_DEPTH);
+		printf("  --jit=MODE        compile hot assignments to machine code: off, on (default) or always\n");
+		printf("  --profile         count how often each line runs and how long it takes, and print the\n");
+		printf("                    hottest ones when the program finishes\n");
+		printf("  --profile-folded=FILE  profile, and write the time spent in each statement under each\n");
+		printf("                    chain of GOSUBs to FILE as folded stacks (for flame graphs)\n");
+		printf("  --stats           print how long each phase took, how many of each token were lexed,\n");
+		printf("                    what was allocated and the peak memory use when the program finishes\n");
 		return EXIT_SUCCESS;
 	}
 	
-	char *code = read_file(argv[1]);
+	// a filename of - means the program is streamed in from stdin rather than
+	// being loaded all at once
+	bool streaming = strcmp(options.filename, "-") == 0;
+	SourceFile source = { NULL, 0, false, 0, { 0, 0 } };
+	if (!streaming) source = load_source(options.filename);
+
+	// there's nothing to cache for a program from stdin, and dumping needs the ast
+	bool caching = options.use_cache && !streaming && !options.dump_optimized;
+	CacheStats cache_stats = { caching ? CACHE_MISS : CACHE_DISABLED, NULL, false, 0, 0, 0, 0, 0 };
+	SourceKey key = { { 0, 0 }, 0, 0, 0 };
+	Program program;
+
+	if (caching) {
+		cache_stats.path = cache_path(options.filename);
+
+		double start = monotonic_seconds();
+		key = source_key(&source);
+		cache_stats.hash_seconds = monotonic_seconds() - start;
+
+		start = monotonic_seconds();
+		cache_stats.status = load_cached_program(cache_stats.path, &key, &program, &cache_stats.bytes);
+		cache_stats.load_seconds = monotonic_seconds() - start;
+		add_phase_time(PHASE_CACHE, cache_stats.hash_seconds + cache_stats.load_seconds);
+	}
 
-	ParserResult parser_result = parse(code);
+	if (cache_stats.status != CACHE_HIT) {
+		double start = monotonic_seconds();
+		int status;
 
-	if (parser_result.success) {
-		free(parser_result.result.ast.statements);
-	} else {
-		printf("uh oh\n");
+		if (!build_program(source, streaming, &options, &program, &status)) {
+			if (!streaming) free_source(source);
+			free(cache_stats.path);
+			return status;
+		}
+
+		cache_stats.compile_seconds = monotonic_seconds() - start;
+
+		if (caching) {
+			start = monotonic_seconds();
+			cache_stats.bytes = write_cached_program(cache_stats.path, &key, &program);
+			cache_stats.written = cache_stats.bytes > 0;
+			cache_stats.write_seconds = monotonic_seconds() - start;
+			add_phase_time(PHASE_CACHE, cache_stats.write_seconds);
+		}
+	}
+
+	if (options.cache_stats) print_cache_stats(&cache_stats);
+
+	if (options.profile) active_profile = new_profile(&program);
+
+	run_program(&program);
+
+	if (options.profile) {
+		print_profile(stderr, active_profile, streaming ? NULL : source.code);
+
+		if (options.folded_path != NULL && !write_folded_stacks(options.folded_path, active_profile))
+			fprintf(stderr, "Warning: couldn't write the folded stacks to %s\n", options.folded_path);
+
+		free_profile(active_profile);
 	}
 
-	free(code);
+	print_run_stats();
+
+	free_program(program);
+	free(cache_stats.path);
+	if (!streaming) free_source(source);
 
 	return EXIT_SUCCESS;
 }
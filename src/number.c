@@ -0,0 +1,334 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "number.h"
+#include "utils.h"
+
+// every power of ten up to 10^22 is exactly representable as a double
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_MANTISSA ((uint64_t)1 << 53)
+#define MAX_EXACT_POWER 22
+#define MAX_MANTISSA_DIGITS 19
+
+static double slow_decimal_to_double(char *string, size_t length) {
+	// strtod needs a null terminated copy, and it's only needed for long
+	// literals so the allocation doesn't matter much
+	char stack_buffer[64];
+	char *buffer = length < sizeof(stack_buffer) ? stack_buffer : malloc(length + 1);
+	ensure_alloc(buffer);
+
+	memcpy(buffer, string, length);
+	buffer[length] = '\0';
+
+	double number = strtod(buffer, NULL);
+
+	if (buffer != stack_buffer) free(buffer);
+	return number;
+}
+
+double decimal_to_double(char *string, size_t length) {
+	uint64_t mantissa = 0;
+	size_t digits = 0; // significant digits in the mantissa
+	int exponent = 0;
+	bool after_point = false;
+
+	for (size_t i = 0; i < length; i++) {
+		char ch = string[i];
+
+		if (ch == '.') {
+			after_point = true;
+			continue;
+		}
+
+		if (after_point) exponent--;
+
+		// leading zeros don't count towards the digits we can hold
+		if (digits == 0 && ch == '0') continue;
+
+		if (digits == MAX_MANTISSA_DIGITS) return slow_decimal_to_double(string, length);
+
+		mantissa = mantissa * 10 + (ch - '0');
+		digits++;
+	}
+
+	// if both the mantissa and the power of ten are exact then a single
+	// division is correctly rounded (Clinger's fast path)
+	if (mantissa <= MAX_EXACT_MANTISSA && -exponent <= MAX_EXACT_POWER)
+		return (double)mantissa / powers_of_ten[-exponent];
+
+	return slow_decimal_to_double(string, length);
+}
+
+// formatting uses grisu2 (from florian loitsch's "printing floating-point
+// numbers quickly and accurately with integers"). it works out the digits with
+// 64 bit integer maths between the two numbers halfway to the doubles either
+// side, so the digits always read back as the same double. they're the
+// shortest possible for all but a tiny fraction of numbers
+
+typedef struct {
+	uint64_t f;
+	int e;
+} DiyFp;
+
+#define HIDDEN_BIT ((uint64_t)1 << 52)
+#define SIGNIFICAND_MASK (HIDDEN_BIT - 1)
+#define EXPONENT_BIAS (0x3FF + 52)
+
+// 10^k for k = -348, -340, ..., 340, normalised so the top bit is set
+static const DiyFp cached_powers[] = {
+	{ 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+	{ 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+	{ 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+	{ 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+	{ 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+	{ 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+	{ 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+	{ 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+	{ 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+	{ 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+	{ 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+	{ 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+	{ 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+	{ 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+	{ 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+	{ 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+	{ 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+	{ 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+	{ 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+	{ 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+	{ 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+	{ 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+	{ 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+	{ 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+	{ 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+	{ 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+	{ 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+	{ 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+	{ 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 }
+};
+
+static const uint64_t powers_of_ten_64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static DiyFp double_to_diy_fp(double number) {
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(double));
+
+	int biased_exponent = (bits >> 52) & 0x7FF;
+	uint64_t significand = bits & SIGNIFICAND_MASK;
+
+	// subnormals don't have the hidden bit
+	if (biased_exponent == 0) return (DiyFp){ significand, 1 - EXPONENT_BIAS };
+	return (DiyFp){ significand + HIDDEN_BIT, biased_exponent - EXPONENT_BIAS };
+}
+
+static inline DiyFp normalise(DiyFp x) {
+	int shift = __builtin_clzll(x.f);
+	return (DiyFp){ x.f << shift, x.e - shift };
+}
+
+// the top 64 bits of the product, rounded
+static inline DiyFp multiply(DiyFp x, DiyFp y) {
+	unsigned __int128 product = (unsigned __int128)x.f * y.f;
+	uint64_t high = product >> 64, low = (uint64_t)product;
+	return (DiyFp){ high + (low >> 63), x.e + y.e + 64 };
+}
+
+// the points halfway between the number and its neighbours, with the same
+// exponent as each other
+static void boundaries(DiyFp v, DiyFp *minus, DiyFp *plus) {
+	*plus = normalise((DiyFp){ (v.f << 1) + 1, v.e - 1 });
+
+	// the gap below a power of two is half the size of the one above it
+	if (v.f == HIDDEN_BIT) *minus = (DiyFp){ (v.f << 2) - 1, v.e - 2 };
+	else *minus = (DiyFp){ (v.f << 1) - 1, v.e - 1 };
+
+	minus->f <<= minus->e - plus->e;
+	minus->e = plus->e;
+}
+
+// picks a power of ten that brings the binary exponent into [-60, -32] once
+// it's multiplied in, and sets k to the negated decimal exponent of it
+static DiyFp cached_power(int e, int *k) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int rounded_k = (int)dk;
+	if (dk - rounded_k > 0.0) rounded_k++;
+
+	unsigned index = (rounded_k >> 3) + 1;
+	*k = -(-348 + (int)(index << 3));
+	return cached_powers[index];
+}
+
+// nudges the last digit down while that gets closer to the real number
+// without leaving the range that reads back correctly
+static void round_last_digit(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+	while (
+		rest < wp_w && delta - rest >= ten_kappa &&
+		(rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)
+	) {
+		digits[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static int count_digits(uint32_t n) {
+	int digits = 1;
+	while (n >= 10 && digits < 10) {
+		n /= 10;
+		digits++;
+	}
+	return digits;
+}
+
+// generates digits of the upper boundary until they're within delta of it
+static void generate_digits(DiyFp w, DiyFp upper, uint64_t delta, char *digits, int *length, int *k) {
+	DiyFp one = { (uint64_t)1 << -upper.e, upper.e };
+	uint64_t wp_w = upper.f - w.f;
+	uint32_t integral = upper.f >> -one.e;
+	uint64_t fraction = upper.f & (one.f - 1);
+	int kappa = count_digits(integral);
+	*length = 0;
+
+	while (kappa > 0) {
+		uint32_t power = powers_of_ten_64[kappa - 1];
+		uint32_t digit = integral / power;
+		integral %= power;
+
+		if (digit != 0 || *length != 0) digits[(*length)++] = '0' + digit;
+		kappa--;
+
+		uint64_t rest = ((uint64_t)integral << -one.e) + fraction;
+		if (rest <= delta) {
+			*k += kappa;
+			round_last_digit(digits, *length, delta, rest, powers_of_ten_64[kappa] << -one.e, wp_w);
+			return;
+		}
+	}
+
+	while (true) {
+		fraction *= 10;
+		delta *= 10;
+
+		char digit = fraction >> -one.e;
+		if (digit != 0 || *length != 0) digits[(*length)++] = '0' + digit;
+		fraction &= one.f - 1;
+		kappa--;
+
+		if (fraction < delta) {
+			*k += kappa;
+			round_last_digit(digits, *length, delta, fraction, one.f, -kappa < 20 ? wp_w * powers_of_ten_64[-kappa] : 0);
+			return;
+		}
+	}
+}
+
+// the number is the digits times 10^k. it has to be positive and finite
+static void grisu2(double number, char *digits, int *length, int *k) {
+	DiyFp v = double_to_diy_fp(number);
+	DiyFp minus, plus;
+	boundaries(v, &minus, &plus);
+
+	DiyFp power = cached_power(plus.e, k);
+	DiyFp w = multiply(normalise(v), power);
+	DiyFp upper = multiply(plus, power);
+	DiyFp lower = multiply(minus, power);
+
+	// the products can be out by one either way, so stay on the safe side
+	lower.f++;
+	upper.f--;
+
+	generate_digits(w, upper, upper.f - lower.f, digits, length, k);
+}
+
+static size_t write_exponent(char *out, int exponent) {
+	size_t length = 0;
+	out[length++] = 'e';
+	out[length++] = exponent < 0 ? '-' : '+';
+	if (exponent < 0) exponent = -exponent;
+
+	// at least two digits, like printf
+	if (exponent >= 100) out[length++] = '0' + exponent / 100;
+	out[length++] = '0' + exponent / 10 % 10;
+	out[length++] = '0' + exponent % 10;
+
+	return length;
+}
+
+size_t format_number(double number, char *out) {
+	size_t length = 0;
+
+	// which nan comes out of adding (or multiplying) two of them depends on
+	// which way round the compiler put the operands, so a nan's sign doesn't
+	// mean anything and isn't printed
+	if (isnan(number)) {
+		memcpy(out, "nan", 3);
+		return 3;
+	}
+
+	if (signbit(number)) {
+		out[length++] = '-';
+		number = -number;
+	}
+
+	if (isinf(number)) {
+		memcpy(out + length, "inf", 3);
+		return length + 3;
+	}
+
+	if (number == 0) {
+		out[length++] = '0';
+		return length;
+	}
+
+	char digits[20];
+	int digits_length, k;
+	grisu2(number, digits, &digits_length, &k);
+
+	// the power of ten of the first digit
+	int exponent = digits_length + k - 1;
+
+	if (exponent < -4 || exponent >= 16) {
+		out[length++] = digits[0];
+
+		if (digits_length > 1) {
+			out[length++] = '.';
+			memcpy(out + length, digits + 1, digits_length - 1);
+			length += digits_length - 1;
+		}
+
+		return length + write_exponent(out + length, exponent);
+	}
+
+	if (exponent < 0) {
+		out[length++] = '0';
+		out[length++] = '.';
+		for (int i = -1; i > exponent; i--) out[length++] = '0';
+		memcpy(out + length, digits, digits_length);
+		return length + digits_length;
+	}
+
+	// the digits before the point, padded with zeros if it's a whole number
+	// with fewer digits than that
+	int integer_digits = exponent + 1;
+	for (int i = 0; i < integer_digits; i++)
+		out[length++] = i < digits_length ? digits[i] : '0';
+
+	if (digits_length > integer_digits) {
+		out[length++] = '.';
+		memcpy(out + length, digits + integer_digits, digits_length - integer_digits);
+		length += digits_length - integer_digits;
+	}
+
+	return length;
+}
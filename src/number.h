@@ -0,0 +1,18 @@
+#ifndef INCLUDE_NUMBER_H
+#define INCLUDE_NUMBER_H
+
+#include <stddef.h>
+
+// converts a string of digits with an optional decimal point (what the lexer
+// accepts as a number) to the nearest double
+extern double decimal_to_double(char *string, size_t length);
+
+// the most chars format_number can write, with room to spare
+#define FORMATTED_NUMBER_SIZE 32
+
+// writes the shortest digits that read back as exactly the same double, in
+// plain notation unless the exponent is very big or small (then like 1.5e+20).
+// returns how many chars were written, and doesn't add a null byte
+extern size_t format_number(double number, char *out);
+
+#endif  // INCLUDE_NUMBER_H
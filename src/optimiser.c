@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "optimiser.h"
+#include "builtins.h"
+#include "stats.h"
+
+// the output pool is built in post-order too, so anything dropped by a
+// rewrite is always at the end of it and can be removed by shortening it
+
+static inline bool is_number(ExprPool *pool, ExprIndex index, double value) {
+	return pool->kinds[index] == EXPR_NUMBER && pool->values[index].number == value;
+}
+
+static inline ExprIndex replace_with_number(ExprPool *pool, ExprIndex start, double value) {
+	pool->length = start;
+	return push_expr_node(pool, EXPR_NUMBER, 0, (ExprValue){ .number = value });
+}
+
+static inline ExprIndex copy_node(ExprPool *in, ExprIndex index, ExprPool *out, ExprValue value) {
+	return push_expr_node(out, in->kinds[index], in->ops[index], value);
+}
+
+// works out an operator on constants the same way the vm would
+static double fold_binary(char op, double lhs, double rhs) {
+	switch (op) {
+		case '+': return lhs + rhs;
+		case '-': return lhs - rhs;
+		case '*': return lhs * rhs;
+		case '/': return lhs / rhs;
+		case '^': return pow(lhs, rhs);
+		case '=': return lhs == rhs ? -1 : 0;
+		case COMPARE_NOT_EQUAL: return lhs != rhs ? -1 : 0;
+		case '<': return lhs < rhs ? -1 : 0;
+		case COMPARE_LESS_EQUAL: return lhs <= rhs ? -1 : 0;
+		case '>': return lhs > rhs ? -1 : 0;
+		default: return lhs >= rhs ? -1 : 0;
+	}
+}
+
+// the strength reductions only apply when one side is a particular constant.
+// note that x + 0 and 0 * x aren't here because they're wrong for -0,
+// infinities and nans. 1 * x is dealt with before the rhs is optimised
+static ExprIndex optimise_binary(ExprPool *out, char op, ExprIndex lhs, ExprIndex rhs) {
+	if (out->kinds[lhs] == EXPR_NUMBER && out->kinds[rhs] == EXPR_NUMBER)
+		return replace_with_number(out, lhs, fold_binary(op, out->values[lhs].number, out->values[rhs].number));
+
+	bool drop_rhs = false;
+
+	switch (op) {
+		case '*':
+		case '/': drop_rhs = is_number(out, rhs, 1); break;
+		case '-': drop_rhs = is_number(out, rhs, 0) && !signbit(out->values[rhs].number); break;
+		case '^':
+			drop_rhs = is_number(out, rhs, 1);
+
+			// squaring is one multiply instead of a call to pow, but only when the
+			// base is cheap to evaluate twice. this gives the ieee x * x, which is
+			// correctly rounded. c doesn't promise that of pow(x, 2), so the last
+			// bit can differ on a libm that gets it wrong
+			if (is_number(out, rhs, 2) && out->kinds[lhs] == EXPR_VAR) {
+				out->kinds[rhs] = EXPR_VAR;
+				out->values[rhs] = out->values[lhs];
+				return push_expr_node(out, EXPR_BINARY, '*', (ExprValue){ .lhs = lhs });
+			}
+			break;
+	}
+
+	if (drop_rhs) {
+		out->length = rhs;
+		return lhs;
+	}
+
+	return push_expr_node(out, EXPR_BINARY, op, (ExprValue){ .lhs = lhs });
+}
+
+// negations and builtins, once their operand has been optimised
+static ExprIndex optimise_unary(ExprPool *in, ExprIndex index, ExprPool *out, ExprIndex operand) {
+	if (in->kinds[index] == EXPR_NEGATE) {
+		if (out->kinds[operand] == EXPR_NUMBER)
+			return replace_with_number(out, operand, -out->values[operand].number);
+
+		// --x is x
+		if (out->kinds[operand] == EXPR_NEGATE) {
+			out->length = operand;
+			return operand - 1;
+		}
+	} else if (out->kinds[operand] == EXPR_NUMBER) {
+		// builtins don't have side effects, so they can be folded too
+		return replace_with_number(out, operand, builtins[in->ops[index]].function(out->values[operand].number));
+	}
+
+	return copy_node(in, index, out, in->values[index]);
+}
+
+static inline void push_frame(OptimiseStack *stack, ExprIndex index) {
+	if (stack->length == stack->capacity) {
+		stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+		stack->frames = realloc(stack->frames, sizeof(OptimiseFrame) * stack->capacity);
+		ensure_alloc(stack->frames);
+		count_alloc(STATS_AST, sizeof(OptimiseFrame) * stack->capacity);
+	}
+
+	stack->frames[stack->length++] = (OptimiseFrame){ index, 0, 0 };
+}
+
+ExprIndex optimise_expr(ExprPool *in, ExprIndex index, ExprPool *out, OptimiseStack *stack) {
+	size_t base = stack->length;
+	ExprIndex result; // the last expression to be finished, in out
+
+	while (true) {
+		// go down through first operands, leaving a frame for every expression
+		// on the way, until there's a leaf
+		while (true) {
+			ExprKind kind = in->kinds[index];
+
+			if (kind == EXPR_NEGATE || kind == EXPR_BUILTIN) {
+				push_frame(stack, index);
+				index--;
+			} else if (kind == EXPR_BINARY || kind == EXPR_CONCAT) {
+				push_frame(stack, index);
+				index = in->values[index].lhs;
+			} else break;
+		}
+
+		if (in->kinds[index] == EXPR_STRING) result = push_string_node(out, in->strings[in->values[index].string]);
+		else result = copy_node(in, index, out, in->values[index]);
+
+		// then back up, finishing expressions until one has an rhs to optimise,
+		// which is where the next trip down starts
+		while (true) {
+			if (stack->length == base) return result;
+
+			OptimiseFrame *frame = &stack->frames[stack->length - 1];
+			ExprIndex node = frame->index;
+			ExprKind kind = in->kinds[node];
+
+			if (kind == EXPR_NEGATE || kind == EXPR_BUILTIN) {
+				result = optimise_unary(in, node, out, result);
+			} else if (frame->state == 0) {
+				index = node - 1;
+
+				// 1 * x is x, and since the 1 is a single node it can just be
+				// dropped. the rhs then takes this expression's place
+				if (kind == EXPR_BINARY && in->ops[node] == '*' && is_number(out, result, 1)) {
+					out->length = result;
+					stack->length--;
+					break;
+				}
+
+				frame->state = 1;
+				frame->lhs = result;
+				break;
+			} else if (kind == EXPR_BINARY) {
+				result = optimise_binary(out, in->ops[node], frame->lhs, result);
+			} else {
+				// strings point into the code, so there's nowhere to put two joined
+				// together and they're left for the vm
+				result = push_expr_node(out, EXPR_CONCAT, '+', (ExprValue){ .lhs = frame->lhs });
+			}
+
+			stack->length--;
+		}
+	}
+}
+
+static void optimise_statement(ExprPool *in, Statement *statement, ExprPool *out, OptimiseStack *stack) {
+	// the conditions in a chain of IFs come one after another
+	while (statement->type == STATEMENT_IF) {
+		statement->statement.if_then.condition = optimise_expr(in, statement->statement.if_then.condition, out, stack);
+		statement = statement->statement.if_then.then;
+	}
+
+	switch (statement->type) {
+		case STATEMENT_ASSIGNMENT:
+			statement->statement.assignment.expr = optimise_expr(in, statement->statement.assignment.expr, out, stack);
+			break;
+		case STATEMENT_PRINT: {
+			ExprList *exprs = statement->statement.print;
+			for (size_t j = 0; j < exprs->length; j++)
+				exprs->exprs[j] = optimise_expr(in, exprs->exprs[j], out, stack);
+			break;
+		}
+		default: break;
+	}
+}
+
+void optimise_ast(AST *ast) {
+	double start = start_phase();
+	ExprPool in = ast->exprs;
+	ExprPool out = new_expr_pool();
+	OptimiseStack stack = { NULL, 0, 0 };
+
+	for (size_t i = 0; i < ast->length; i++)
+		optimise_statement(&in, &ast->statements[i], &out, &stack);
+
+	free(stack.frames);
+	free_expr_pool(&in);
+	ast->exprs = out;
+	end_phase(PHASE_OPTIMISE, start);
+}
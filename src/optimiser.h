@@ -0,0 +1,29 @@
+#ifndef INCLUDE_OPTIMISER_H
+#define INCLUDE_OPTIMISER_H
+
+#include "parser.h"
+
+// an expression the optimiser is part way through, and how far it's got
+typedef struct {
+	ExprIndex index; // in the input pool
+	uint8_t state; // 1 once its lhs has been optimised (unary ones don't need it)
+	ExprIndex lhs; // in the output pool, once it's been optimised
+} OptimiseFrame;
+
+// expressions are walked with this instead of by recursing, so deeply nested
+// ones can't overflow the stack. it can be reused for every expression
+typedef struct {
+	OptimiseFrame *frames;
+	size_t length, capacity;
+} OptimiseStack;
+
+// copies the expression at index from one pool into another, rewriting it so
+// there's less to do at runtime. apart from squaring (see optimise_binary),
+// every rewrite gives exactly the same result as the original would have
+// (down to the sign of zero and nans). returns the index of the new root in out
+extern ExprIndex optimise_expr(ExprPool *in, ExprIndex index, ExprPool *out, OptimiseStack *stack);
+
+// rebuilds the ast's expression pool with every expression optimised
+extern void optimise_ast(AST *ast);
+
+#endif  // INCLUDE_OPTIMISER_H
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "number.h"
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t buffer_length = 0;
+static size_t column = 0;
+
+static bool initialised = false;
+static bool line_buffered = false;
+
+static void write_all(const char *bytes, size_t length) {
+	while (length > 0) {
+		ssize_t written = write(STDOUT_FILENO, bytes, length);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return; // there's nowhere to report it, so the output is dropped
+		}
+
+		bytes += written;
+		length -= written;
+	}
+}
+
+void flush_output(void) {
+	if (buffer_length == 0) return;
+
+	write_all(buffer, buffer_length);
+	buffer_length = 0;
+}
+
+// works out whether stdout is a terminal, and makes sure whatever's left gets
+// written if the program exits from somewhere else
+static void initialise(void) {
+	initialised = true;
+	line_buffered = isatty(STDOUT_FILENO);
+	atexit(flush_output);
+
+	// anything printed through stdio before now has to come out first
+	fflush(stdout);
+}
+
+static inline void reserve(size_t length) {
+	if (!initialised) initialise();
+	if (buffer_length + length > OUTPUT_BUFFER_SIZE) flush_output();
+}
+
+void output_bytes(const char *bytes, size_t length) {
+	// only what comes after the last newline counts towards the column
+	size_t after_newline = 0;
+	while (after_newline < length && bytes[length - after_newline - 1] != '\n') after_newline++;
+	column = after_newline == length ? column + length : after_newline;
+
+	reserve(length);
+
+	// anything too big for the buffer goes straight out
+	if (length > OUTPUT_BUFFER_SIZE) {
+		write_all(bytes, length);
+		return;
+	}
+
+	memcpy(buffer + buffer_length, bytes, length);
+	buffer_length += length;
+}
+
+void output_char(char ch) {
+	reserve(1);
+	buffer[buffer_length++] = ch;
+	column = ch == '\n' ? 0 : column + 1;
+	if (ch == '\n' && line_buffered) flush_output();
+}
+
+void output_number(double number) {
+	reserve(FORMATTED_NUMBER_SIZE);
+	size_t length = format_number(number, buffer + buffer_length);
+	buffer_length += length;
+	column += length;
+}
+
+void output_zone(void) {
+	static const char spaces[PRINT_ZONE_WIDTH] = "              ";
+	output_bytes(spaces, PRINT_ZONE_WIDTH - column % PRINT_ZONE_WIDTH);
+}
@@ -0,0 +1,29 @@
+#ifndef INCLUDE_OUTPUT_H
+#define INCLUDE_OUTPUT_H
+
+#include <stddef.h>
+
+// everything a program prints is collected in one big buffer and written out
+// with write() when it fills up, rather than going through stdio a piece at a
+// time. it's also flushed when the program finishes (or the process exits),
+// and after every line when stdout is a terminal so output still shows up as
+// it's printed
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+// a comma in PRINT moves on to the start of the next zone this many columns
+// wide, the way other BASICs line values up into columns
+#define PRINT_ZONE_WIDTH 14
+
+extern void output_bytes(const char *bytes, size_t length);
+extern void output_char(char ch);
+extern void output_number(double number);
+
+// pads with spaces up to the start of the next print zone. the column is
+// counted in bytes since the last newline that went through here
+extern void output_zone(void);
+
+// anything that reads input or writes to stdout some other way has to call
+// this first so the output comes out in the right order
+extern void flush_output(void);
+
+#endif  // INCLUDE_OUTPUT_H
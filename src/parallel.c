@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "parser.h"
+#include "workers.h"
+#include "scan.h"
+#include "utils.h"
+#include "stats.h"
+
+// more chunks than threads so a thread that gets a quick chunk can take
+// another one instead of sitting idle
+#define CHUNKS_PER_THREAD 4
+
+typedef struct {
+	size_t start, end;
+	size_t lines; // newlines in the chunk
+	ParserResult result;
+
+	// where this chunk's parts go once everything's stitched together
+	Symbol *symbols;
+	size_t first_node, first_string, first_statement, first_line;
+} Chunk;
+
+typedef struct {
+	char *code;
+	Chunk *chunks;
+	AST *ast;
+} ParallelParse;
+
+static void parse_chunk(void *context, size_t task) {
+	ParallelParse *parse = context;
+	Chunk *chunk = &parse->chunks[task];
+	chunk->result = parse_range(parse->code, chunk->start, chunk->end);
+
+	char *end = parse->code + chunk->end;
+	chunk->lines = 0;
+	for (char *ch = parse->code + chunk->start; (ch = memchr(ch, '\n', end - ch)) != NULL; ch++)
+		chunk->lines++;
+}
+
+// the statement belongs to this chunk (as do any it contains), so it can be
+// changed where it is
+static void place_statement(Chunk *chunk, Statement *statement) {
+	// a chain of IFs is followed in a loop, so a long one can't overflow the stack
+	while (statement->type == STATEMENT_IF) {
+		statement->line += chunk->first_line;
+		statement->statement.if_then.condition += chunk->first_node;
+		statement = statement->statement.if_then.then;
+	}
+
+	statement->line += chunk->first_line;
+
+	switch (statement->type) {
+		case STATEMENT_ASSIGNMENT:
+			statement->statement.assignment.variable = chunk->symbols[statement->statement.assignment.variable];
+			statement->statement.assignment.expr += chunk->first_node;
+			break;
+		case STATEMENT_PRINT: {
+			ExprList *exprs = statement->statement.print;
+			for (size_t j = 0; j < exprs->length; j++)
+				exprs->exprs[j] += chunk->first_node;
+			break;
+		}
+		case STATEMENT_LABEL:
+			statement->statement.label.line += chunk->first_line;
+			break;
+		case STATEMENT_GOTO:
+		case STATEMENT_GOSUB:
+			statement->statement.jump.line += chunk->first_line;
+			break;
+		case STATEMENT_IF: // placed above
+		case STATEMENT_RETURN:
+		case STATEMENT_END: break;
+	}
+}
+
+// copies a chunk's expressions and statements into their place in the ast,
+// moving indices and symbols along as it goes. every chunk has its own
+// stretch of the ast so these can all run at once
+static void place_chunk(void *context, size_t task) {
+	ParallelParse *parse = context;
+	Chunk *chunk = &parse->chunks[task];
+	AST *from = &chunk->result.result.ast;
+	ExprPool *pool = &parse->ast->exprs;
+
+	memcpy(pool->kinds + chunk->first_node, from->exprs.kinds, from->exprs.length);
+	memcpy(pool->ops + chunk->first_node, from->exprs.ops, from->exprs.length);
+	memcpy(pool->strings + chunk->first_string, from->exprs.strings, sizeof(StringSlice) * from->exprs.strings_length);
+
+	for (size_t i = 0; i < from->exprs.length; i++) {
+		ExprValue value = from->exprs.values[i];
+
+		switch (from->exprs.kinds[i]) {
+			case EXPR_STRING: value.string += chunk->first_string; break;
+			case EXPR_VAR: value.variable = chunk->symbols[value.variable]; break;
+			case EXPR_BINARY:
+			case EXPR_CONCAT: value.lhs += chunk->first_node; break;
+			default: break;
+		}
+
+		pool->values[chunk->first_node + i] = value;
+	}
+
+	for (size_t i = 0; i < from->length; i++) {
+		place_statement(chunk, &from->statements[i]);
+		parse->ast->statements[chunk->first_statement + i] = from->statements[i];
+	}
+}
+
+// chunks are parsed with their own line numbers, so errors need moving down
+// by however many lines come before them. the lists are joined in order and
+// cut off at max_errors, which gives the same list as parsing in one go
+static ParserResult join_errors(Chunk *chunks, size_t chunk_count) {
+	ErrorList joined = { NULL, 0, false };
+	size_t lines_before = 0;
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		Chunk *chunk = &chunks[i];
+
+		if (chunk->result.success) {
+			free_ast(chunk->result.result.ast);
+		} else {
+			ErrorList errors = chunk->result.result.errors;
+			size_t keep = errors.length;
+			if (max_errors != 0 && joined.length + keep > max_errors)
+				keep = max_errors - joined.length;
+			if (errors.truncated || keep < errors.length) joined.truncated = true;
+
+			joined.errors = realloc(joined.errors, sizeof(Error) * (joined.length + keep + 1));
+			ensure_alloc(joined.errors);
+			count_alloc(STATS_PARSER, sizeof(Error) * (joined.length + keep + 1));
+
+			for (size_t e = 0; e < errors.length; e++) {
+				if (e < keep) {
+					joined.errors[joined.length] = errors.errors[e];
+					joined.errors[joined.length++].line += lines_before;
+				} else {
+					free(errors.errors[e].message);
+				}
+			}
+
+			free(errors.errors);
+		}
+
+		lines_before += chunk->lines;
+	}
+
+	return (ParserResult){ false, { .errors = joined } };
+}
+
+static size_t split_chunks(char *code, size_t length, size_t thread_count, Chunk **chunks) {
+	size_t target_count = thread_count * CHUNKS_PER_THREAD;
+	size_t chunk_size = length / target_count;
+	if (chunk_size < PARALLEL_MIN_CHUNK_SIZE) chunk_size = PARALLEL_MIN_CHUNK_SIZE;
+
+	*chunks = malloc(sizeof(Chunk) * (length / chunk_size + 1));
+	ensure_alloc(*chunks);
+	count_alloc(STATS_PARSER, sizeof(Chunk) * (length / chunk_size + 1));
+
+	// strings and comments can't go over more than one line, so the start of
+	// any line is a safe place to split
+	size_t count = 0, start = 0;
+	while (start < length) {
+		size_t end = length;
+
+		if (length - start > chunk_size) {
+			char *newline = memchr(code + start + chunk_size, '\n', length - start - chunk_size);
+			if (newline != NULL) end = newline - code + 1;
+		}
+
+		(*chunks)[count++] = (Chunk){ .start = start, .end = end };
+		start = end;
+	}
+
+	return count;
+}
+
+ParserResult parse_parallel(char *code, size_t length, size_t thread_count) {
+	if (thread_count <= 1 || length < PARALLEL_MIN_CHUNK_SIZE * 2)
+		return parse(code);
+
+	double start = start_phase();
+
+	// picked here so the lexers on the workers find it already chosen
+	select_scanner();
+
+	Chunk *chunks;
+	size_t chunk_count = split_chunks(code, length, thread_count, &chunks);
+	AST ast = new_ast();
+	ParallelParse parse = { code, chunks, &ast };
+
+	run_tasks(chunk_count, thread_count, parse_chunk, &parse);
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		if (chunks[i].result.success) continue;
+
+		ParserResult result = join_errors(chunks, chunk_count);
+		free(chunks);
+		free_ast(ast);
+		end_phase(PHASE_PARSE, start);
+		return result;
+	}
+
+	// interning every chunk's names in order gives them the same ids they'd
+	// have had if it was all parsed in one go
+	size_t nodes = 0, strings = 0, statements = 0, lines = 0;
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		AST *chunk_ast = &chunks[i].result.result.ast;
+		SymbolTable *chunk_symbols = &chunk_ast->symbols;
+
+		chunks[i].symbols = malloc(sizeof(Symbol) * (chunk_symbols->length + 1));
+		ensure_alloc(chunks[i].symbols);
+		count_alloc(STATS_PARSER, sizeof(Symbol) * (chunk_symbols->length + 1));
+
+		for (size_t s = 0; s < chunk_symbols->length; s++)
+			chunks[i].symbols[s] = intern_symbol(&ast.symbols, chunk_symbols->names[s], chunk_symbols->lengths[s]);
+
+		chunks[i].first_node = nodes;
+		chunks[i].first_string = strings;
+		chunks[i].first_statement = statements;
+		chunks[i].first_line = lines;
+		nodes += chunk_ast->exprs.length;
+		strings += chunk_ast->exprs.strings_length;
+		statements += chunk_ast->length;
+		lines += chunks[i].lines;
+	}
+
+	ast.exprs = (ExprPool){
+		malloc(nodes + 1), malloc(nodes + 1), malloc(sizeof(ExprValue) * (nodes + 1)), nodes, nodes + 1,
+		malloc(sizeof(StringSlice) * (strings + 1)), strings, strings + 1
+	};
+	ensure_alloc(ast.exprs.kinds);
+	ensure_alloc(ast.exprs.ops);
+	ensure_alloc(ast.exprs.values);
+	ensure_alloc(ast.exprs.strings);
+	count_alloc(STATS_AST, (2 + sizeof(ExprValue)) * (nodes + 1) + sizeof(StringSlice) * (strings + 1));
+
+	ast.statements = arena_alloc(&ast.arena, sizeof(Statement) * (statements + 1));
+	ast.length = statements;
+	ast.capacity = statements + 1;
+
+	run_tasks(chunk_count, thread_count, place_chunk, &parse);
+
+	// string slices and print lists still point into the chunks' arenas, so
+	// those get kept
+	for (size_t i = 0; i < chunk_count; i++) {
+		AST *chunk_ast = &chunks[i].result.result.ast;
+		arena_adopt(&ast.arena, &chunk_ast->arena);
+		free_ast(*chunk_ast);
+		free(chunks[i].symbols);
+	}
+
+	free(chunks);
+	end_phase(PHASE_PARSE, start);
+
+	return (ParserResult){ true, { .ast = ast } };
+}
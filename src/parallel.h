@@ -0,0 +1,16 @@
+#ifndef INCLUDE_PARALLEL_H
+#define INCLUDE_PARALLEL_H
+
+#include <stddef.h>
+
+#include "parser.h"
+
+// inputs smaller than this aren't worth splitting up
+#define PARALLEL_MIN_CHUNK_SIZE (256 * 1024)
+
+// parses the code in chunks of whole lines on thread_count threads, then
+// stitches the chunks back together in order. the result is exactly what
+// parse would give, including the symbol ids and errors
+extern ParserResult parse_parallel(char *code, size_t length, size_t thread_count);
+
+#endif  // INCLUDE_PARALLEL_H
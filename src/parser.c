@@ -1,93 +1,245 @@
 #include <stdlib.h>
-#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #include "parser.h"
 #include "lexer.h"
+#include "arena.h"
 #include "utils.h"
-#include "debug.h"
+#include "builtins.h"
+#include "symbols.h"
+#include "stats.h"
 
-void free_expr(Expr expr) {
-	switch (expr.type) {
-		case EXPR_NUMBER: free(expr.expr.number_literal); break;
-		case EXPR_STRING: free(expr.expr.string_literal); break;
-		case EXPR_VAR: free(expr.expr.variable); break;
-		case EXPR_CALL:
-			if (expr.expr.call.name_string != NULL)
-				free(expr.expr.call.name_string);
-			free_expr_list(expr.expr.call.args);
-	}
+ExprPool new_expr_pool(void) {
+	return (ExprPool){ NULL, NULL, NULL, 0, 0, NULL, 0, 0 };
 }
 
-ExprList *new_expr_list_from(size_t length, ...) {
-	va_list args;
-	va_start(args, length);
+void free_expr_pool(ExprPool *pool) {
+	free(pool->kinds);
+	free(pool->ops);
+	free(pool->values);
+	free(pool->strings);
+	*pool = new_expr_pool();
+}
 
-	ExprList *exprs = malloc(sizeof(ExprList));
-	ensure_alloc(exprs);
+ExprIndex push_expr_node(ExprPool *pool, ExprKind kind, uint8_t op, ExprValue value) {
+	if (pool->length == pool->capacity) {
+		pool->capacity = pool->capacity == 0 ? 256 : pool->capacity * 2;
+
+		pool->kinds = realloc(pool->kinds, pool->capacity);
+		pool->ops = realloc(pool->ops, pool->capacity);
+		pool->values = realloc(pool->values, sizeof(ExprValue) * pool->capacity);
+		ensure_alloc(pool->kinds);
+		ensure_alloc(pool->ops);
+		ensure_alloc(pool->values);
+		count_alloc(STATS_AST, (2 + sizeof(ExprValue)) * pool->capacity);
+	}
 
-	exprs->exprs = malloc(sizeof(Expr) * length);
-	ensure_alloc(exprs->exprs);
+	pool->kinds[pool->length] = kind;
+	pool->ops[pool->length] = op;
+	pool->values[pool->length] = value;
 
-	for (int i = 0; i < length; i++)
-		exprs->exprs[i] = va_arg(args, Expr);
+	return pool->length++;
+}
 
-	exprs->length = length;
-	exprs->store_delimiters = false;
+ExprIndex push_string_node(ExprPool *pool, StringSlice string) {
+	if (pool->strings_length == pool->strings_capacity) {
+		pool->strings_capacity = pool->strings_capacity == 0 ? 64 : pool->strings_capacity * 2;
+		pool->strings = realloc(pool->strings, sizeof(StringSlice) * pool->strings_capacity);
+		ensure_alloc(pool->strings);
+		count_alloc(STATS_AST, sizeof(StringSlice) * pool->strings_capacity);
+	}
 
-	return exprs;
+	pool->strings[pool->strings_length] = string;
+	return push_expr_node(pool, EXPR_STRING, 0, (ExprValue){ .string = pool->strings_length++ });
 }
 
-ExprList *empty_expr_list(bool store_delimiters) {
-	ExprList *exprs = malloc(sizeof(ExprList));
-	ensure_alloc(exprs);
+// follows the leftmost operands down to the first node
+ExprIndex expr_start(ExprPool *pool, ExprIndex index) {
+	while (true) {
+		switch (pool->kinds[index]) {
+			case EXPR_NEGATE:
+			case EXPR_BUILTIN: index--; break;
+			case EXPR_BINARY:
+			case EXPR_CONCAT: index = pool->values[index].lhs; break;
+			default: return index;
+		}
+	}
+}
 
-	exprs->exprs = malloc(0);
-	ensure_alloc(exprs->exprs);
+ExprList *empty_expr_list(Arena *arena, bool store_delimiters) {
+	ExprList *exprs = arena_alloc(arena, sizeof(ExprList));
 
+	exprs->exprs = NULL;
 	exprs->length = 0;
+	exprs->capacity = 0;
 	exprs->store_delimiters = store_delimiters;
-
-	if (store_delimiters)
-		exprs->delimiters = empty_buffered_string(4);
+	exprs->delimiters = NULL;
+	exprs->delimiters_length = 0;
 
 	return exprs;
 }
 
-void push_expr(ExprList *exprs, Expr expr) {
-	exprs->exprs = realloc(exprs->exprs, sizeof(Expr) * (exprs->length + 1));
-	ensure_alloc(exprs->exprs);
+void push_expr(Arena *arena, ExprList *exprs, ExprIndex expr) {
+	if (exprs->length == exprs->capacity) {
+		size_t capacity = exprs->capacity == 0 ? 4 : exprs->capacity * 2;
+
+		exprs->exprs = arena_realloc(
+			arena, exprs->exprs, sizeof(ExprIndex) * exprs->capacity, sizeof(ExprIndex) * capacity
+		);
+
+		// there's at most one delimiter after each expression
+		if (exprs->store_delimiters)
+			exprs->delimiters = arena_realloc(arena, exprs->delimiters, exprs->capacity, capacity);
+
+		exprs->capacity = capacity;
+	}
+
 	exprs->exprs[exprs->length++] = expr;
 }
 
-void free_expr_list(ExprList *exprs) {
-	for (size_t i = 0; i < exprs->length; i++)
-		free_expr(exprs->exprs[i]);
+AST new_ast(void) {
+	return (AST){
+		NULL, .length = 0, .capacity = 0,
+		.exprs = new_expr_pool(),
+		.arena = new_arena(ARENA_CHUNK_SIZE),
+		.symbols = new_symbol_table()
+	};
+}
 
-	free(exprs->exprs);
-	if (exprs->store_delimiters) free(exprs->delimiters.buffer);
-	free(exprs);
+void push_statement(AST *ast, Statement statement) {
+	if (ast->length == ast->capacity) {
+		size_t capacity = ast->capacity == 0 ? 64 : ast->capacity * 2;
+		ast->statements = arena_realloc(
+			&ast->arena, ast->statements,
+			sizeof(Statement) * ast->capacity, sizeof(Statement) * capacity
+		);
+		ast->capacity = capacity;
+	}
+
+	ast->statements[ast->length++] = statement;
 }
 
-AST new_ast(void) {
-	Statement *statements = malloc(0);
-	ensure_alloc(statements);
-	return (AST){ statements, .length = 0 };
+// everything in the ast lives in its arena or expression pool so this doesn't
+// need to walk it
+void free_ast(AST ast) {
+	free_expr_pool(&ast.exprs);
+	free_arena(&ast.arena);
+	free_symbol_table(&ast.symbols);
 }
 
-ParseExprResult expected_expression_error(Lexer *lexer) {
-	Token *previous_token = get_most_recent_token(lexer);
+void free_error_list(ErrorList errors) {
+	for (size_t i = 0; i < errors.length; i++)
+		free(errors.errors[i].message);
+
+	free(errors.errors);
+}
+
+bool expr_is_string(ExprPool *pool, ExprIndex expr, SymbolTable *symbols) {
+	return pool->kinds[expr] == EXPR_STRING || pool->kinds[expr] == EXPR_CONCAT ||
+		(pool->kinds[expr] == EXPR_VAR && symbol_is_string(symbols, pool->values[expr].variable));
+}
+
+void print_error(FILE *out, Error error, char *code) {
+	fprintf(out, "Error on line %zu: %s\n", error.line, error.message);
+
+	// there's no code to show if the program was streamed in
+	if (code == NULL) return;
+
+	char *line = code;
+	for (size_t l = 1; l < error.line && line != NULL; l++) {
+		line = strchr(line, '\n');
+		if (line != NULL) line++;
+	}
+
+	if (line == NULL) return;
+
+	size_t line_length = strcspn(line, "\n");
+	fprintf(out, "  %.*s\n  ", (int)line_length, line);
+
+	size_t end_column = error.error_column == (size_t)-1 ? error.start_column : error.error_column;
+	for (size_t c = 1; c <= end_column; c++)
+		fputc(c < error.start_column ? ' ' : '^', out);
+	fputc('\n', out);
+}
+
+// error messages are freed along with the error, so any that are built from
+// parts need to be put together on the heap
+char *join_message(const char *before, const char *after) {
+	StringBuilder message = new_string_builder(strlen(before) + strlen(after));
+	builder_append_str(&message, before);
+	builder_append_str(&message, after);
+	return message.chars;
+}
+
+// the index of the token k after the next one, lexing more if it hasn't been
+// yet. anything past the end of the input is the EOF
+static size_t lex_up_to(Parser *parser, size_t index) {
+	while (index >= parser->tokens->length)
+		if (!lex_more_tokens(parser->tokens)) return parser->tokens->length - 1;
+
+	return index;
+}
+
+static inline size_t peek_index(Parser *parser, size_t k) {
+	size_t index = parser->next + k;
+	return index < parser->tokens->length ? index : lex_up_to(parser, index);
+}
+
+static inline TokenType peek_type(Parser *parser, size_t k) {
+	return parser->tokens->types[peek_index(parser, k)];
+}
+
+// consumes the next token, returning its index. a token that didn't lex is
+// left where it is, so whatever looks at the tokens around the error sees the
+// same ones as the parser did
+static inline size_t advance(Parser *parser) {
+	size_t index = peek_index(parser, 0);
+	parser->next = index + (parser->tokens->types[index] != TOKEN_ERROR);
+	return index;
+}
+
+// statements and line numbers come in order, so their positions are found by
+// moving on from the last one. anything before that (which only errors can
+// want) is looked up from scratch
+static TokenPosition find_position(Parser *parser, size_t token) {
+	TokenStream *tokens = parser->tokens;
+	uint32_t offset = tokens->offsets[token];
+	size_t line = parser->line_index;
+
+	if (line >= tokens->lines_length || tokens->line_starts[line] > offset) {
+		TokenPosition position = token_position(tokens, token);
+		parser->line_index = position.line - tokens->first_line;
+		return position;
+	}
+
+	while (line + 1 < tokens->lines_length && tokens->line_starts[line + 1] <= offset) line++;
+
+	parser->line_index = line;
+	return (TokenPosition){ tokens->first_line + line, offset - tokens->line_starts[line] + 1 };
+}
+
+// lexer errors use string literals for messages, so copy them to make sure
+// every error the parser hands back can be freed the same way
+Error token_error(Parser *parser, size_t token) {
+	Error error = parser->tokens->errors[parser->tokens->literals[token]];
+	error.message = strdup(error.message);
+	return error;
+}
+
+ParseExprResult expected_expression_error(Parser *parser) {
 	size_t line, column;
 
-	if (previous_token == NULL) {
+	if (parser->next == 0) {
 		// if there are no previous tokens then error at the very beginning
 		line = 1;
 		column = 1;
 	} else {
 		// otherwise error at the column after the previous token
-		line = previous_token->line;
-		column = previous_token->column + 1;
+		TokenPosition previous = find_position(parser, parser->next - 1);
+		line = previous.line;
+		column = previous.column + 1;
 	}
 
 	return (ParseExprResult){ false, { .error = {
@@ -95,239 +247,733 @@ ParseExprResult expected_expression_error(Lexer *lexer) {
 	} } };
 }
 
-ParseExprResult parse_expr(Lexer *lexer, bool allow_string) {
-	TokenResult first_token_result = peek_token(lexer);
+// a string literal or string variable on its own. returns false without
+// consuming anything if the next token isn't one
+static bool parse_string_operand(Parser *parser, ExprIndex *expr) {
+	TokenStream *tokens = parser->tokens;
+	size_t token = peek_index(parser, 0);
 
-	if (!first_token_result.success) return expected_expression_error(lexer);
+	if (tokens->types[token] == TOKEN_STRING) {
+		parser->next = token + 1;
+		*expr = push_string_node(parser->exprs, stream_string_value(tokens, token, parser->arena));
+		return true;
+	}
 
-	// if the expression is allowed to be a string then try to parse it as that
-	if (allow_string) {
-		Token first_token = first_token_result.result.token;
-		if (first_token.type == TOKEN_STRING) {
-			next_token(lexer);
-			return (ParseExprResult){ true, { .expr = {
-				EXPR_STRING, { .string_literal = first_token.string_literal }
-			} } };
+	if (tokens->types[token] == TOKEN_NAME && symbol_is_string(parser->symbols, token_symbol(tokens, token))) {
+		parser->next = token + 1;
+		*expr = push_expr_node(parser->exprs, EXPR_VAR, 0, (ExprValue){ .variable = token_symbol(tokens, token) });
+		return true;
+	}
+
+	return false;
+}
+
+ParseExprResult parse_expr(Parser *parser, bool allow_string) {
+	TokenStream *tokens = parser->tokens;
+	size_t first_token = peek_index(parser, 0);
+
+	if (tokens->types[first_token] == TOKEN_ERROR)
+		return (ParseExprResult){ false, { .error = token_error(parser, first_token) } };
+
+	// if the expression is allowed to be a string then try to parse it as that,
+	// where + is the only operator and joins strings together
+	ExprIndex lhs;
+	if (allow_string && parse_string_operand(parser, &lhs)) {
+		while (true) {
+			size_t op = peek_index(parser, 0);
+			if (tokens->types[op] != TOKEN_BINARY_OP || token_char(tokens, op) != '+') break;
+			parser->next = op + 1;
+
+			ExprIndex rhs;
+			if (!parse_string_operand(parser, &rhs)) {
+				TokenPosition at = find_position(parser, op);
+				return (ParseExprResult){ false, { .error = {
+					strdup("Only a string can be added to a string"), at.line, at.column, -1
+				} } };
+			}
+
+			// the rhs was the last thing to go in the pool, like with EXPR_BINARY
+			lhs = push_expr_node(parser->exprs, EXPR_CONCAT, '+', (ExprValue){ .lhs = lhs });
 		}
+
+		return (ParseExprResult){ true, { .expr = lhs } };
 	}
 
 	// default to a mathematical expression
-	return parse_math_expr(lexer, 0);
+	return parse_math_expr(parser, 0);
 }
 
-BindingPower get_binding_power(Token token) {
-	if (token.type == TOKEN_UNARY_OP) {
-		if (token.char_literal == '-') return (BindingPower){ -1, 5 };
-	} else if (token.type == TOKEN_BINARY_OP) {
-		if (strchr("+-", token.char_literal)) return (BindingPower){ 1, 2 };
-		if (strchr("*/", token.char_literal)) return (BindingPower){ 3, 4 };
-		if (token.char_literal == '^') return (BindingPower){ 7, 6 };
+BindingPower get_binding_power(TokenType type, char op) {
+	if (type == TOKEN_UNARY_OP) {
+		if (op == '-') return (BindingPower){ -1, 7 };
+	} else if (type == TOKEN_BINARY_OP) {
+		if (strchr("+-", op)) return (BindingPower){ 3, 4 };
+		if (strchr("*/", op)) return (BindingPower){ 5, 6 };
+		if (op == '^') return (BindingPower){ 9, 8 };
+	} else if (type == TOKEN_COMPARISON || type == TOKEN_ASSIGN) {
+		return (BindingPower){ 1, 2 };
 	}
 
 	printf("Error: attempted to find binding power of unknown operator\n");
 	exit(EXIT_FAILURE);
 }
 
-bool token_ends_expr(TokenResult token_result) {
-	if (!token_result.success) return true;
-
-	switch (token_result.result.token.type) {
+bool token_ends_expr(TokenType type) {
+	switch (type) {
 		case TOKEN_NUMBER:
 		case TOKEN_STRING:
 		case TOKEN_BINARY_OP:
 		case TOKEN_UNARY_OP:
+		case TOKEN_COMPARISON:
+		case TOKEN_ASSIGN: // = is a comparison once it's in an expression
 		case TOKEN_OPEN_PAREN:
 		case TOKEN_NAME: return false;
-		default: return true;
+		default: return true; // including TOKEN_ERROR
 	}
 }
 
-bool token_ends_expr_list(TokenResult token_result) {
-	if (!token_result.success) return true;
-	Token token = token_result.result.token;
-	if (token.type == TOKEN_COMMA || token.type == TOKEN_SEMICOLON) return false;
-	return token_ends_expr(token_result);
+bool token_ends_expr_list(TokenType type) {
+	if (type == TOKEN_COMMA || type == TOKEN_SEMICOLON) return false;
+	return token_ends_expr(type);
 }
 
-ParseExprResult parse_math_expr(Lexer *lexer, uint8_t min_binding_power) {
-	TokenResult token_result = next_token(lexer);
-	if (!token_result.success) return expected_expression_error(lexer);
+// the error for a closing parenthesis that isn't there, after the token that
+// was there instead has been consumed (unless it didn't lex)
+static ParseExprResult closing_paren_error(Parser *parser, size_t open) {
+	TokenPosition previous = find_position(parser, parser->next - 1);
+	TokenPosition at = find_position(parser, open);
+	return (ParseExprResult){ false, { .error = {
+		strdup("Expected closing parenthesis"), previous.line, at.column, previous.column
+	} } };
+}
 
-	Token token = token_result.result.token;
-	Expr lhs;
+size_t max_depth = DEFAULT_MAX_DEPTH;
 
-	switch (token.type) {
-		case TOKEN_NUMBER:
-			lhs = (Expr){ EXPR_NUMBER, { .number_literal = token.string_literal } };
-			break;
-		case TOKEN_STRING:
-			free_token_literal(token);
-			return (ParseExprResult){ false, { .error = {
-				strdup("Math cannot be done with strings"), token.line, token.column, -1
-			} } };
-		case TOKEN_UNARY_OP: {
-			BindingPower binding_power = get_binding_power(token);
-			ParseExprResult arg_result = parse_math_expr(lexer, binding_power.right);
-
-			if (arg_result.success) {
-				lhs = (Expr){ EXPR_CALL, { .call = {
-					.name_char = token.char_literal,
-					.args = new_expr_list_from(1, arg_result.result.expr)
-				} } };
-				break;
-			} else return arg_result;
-		}
-		case TOKEN_OPEN_PAREN: {
-			ParseExprResult expr_result = parse_math_expr(lexer, 0);
+// starts parsing another expression on top of the stack. depth counts the
+// frames, the outermost one included, so an expression is never more than
+// max_depth frames deep
+static bool push_frame(Parser *parser, size_t *depth, uint8_t min_binding_power) {
+	if (max_depth != 0 && *depth >= max_depth) return false;
 
-			if (expr_result.success) {
-				// if we parsed that successfully, then ensure it's closed correctly
-				TokenResult closing_paren = next_token(lexer);
+	if (*depth == parser->frames_capacity) {
+		parser->frames_capacity = parser->frames_capacity == 0 ? 64 : parser->frames_capacity * 2;
+		parser->frames = realloc(parser->frames, sizeof(ExprFrame) * parser->frames_capacity);
+		ensure_alloc(parser->frames);
+		count_alloc(STATS_PARSER, sizeof(ExprFrame) * parser->frames_capacity);
+	}
+
+	parser->frames[(*depth)++] = (ExprFrame){ .min_binding_power = min_binding_power };
+	return true;
+}
+
+static ParseExprResult too_deep_error(Parser *parser, size_t token) {
+	StringBuilder message = new_string_builder(80);
+	builder_append_str(&message, "Expressions can't be nested more than ");
+	builder_append_number(&message, max_depth);
+	builder_append_str(&message, " deep (use --max-depth to change this)");
+
+	TokenPosition at = find_position(parser, token);
+	return (ParseExprResult){ false, { .error = { message.chars, at.line, at.column, -1 } } };
+}
+
+// a pratt parser, but with its own stack instead of recursing. whenever an
+// operand needs a whole expression parsing first (the rhs of an operator, a
+// negation, something in parentheses or an argument) the frame it's in says
+// what it's waiting for and a new one goes on top. when that one finishes,
+// the frame underneath carries on from where it left off
+ParseExprResult parse_math_expr(Parser *parser, uint8_t min_binding_power) {
+	TokenStream *tokens = parser->tokens;
+	size_t depth = 0;
+	push_frame(parser, &depth, min_binding_power);
 
-				if (!closing_paren.success || closing_paren.result.token.type != TOKEN_CLOSE_PAREN) {
-					free_expr(expr_result.result.expr);
-					Token *previous_token = get_most_recent_token(lexer);
+	while (true) {
+		ExprFrame *frame = &parser->frames[depth - 1];
+		size_t token = advance(parser);
+		TokenType type = tokens->types[token];
+
+		if (type == TOKEN_ERROR)
+			return (ParseExprResult){ false, { .error = token_error(parser, token) } };
+
+		// parse an operand, or start parsing the expression inside it
+		switch (type) {
+			case TOKEN_NUMBER:
+				frame->lhs = push_expr_node(parser->exprs, EXPR_NUMBER, 0, (ExprValue){ .number = token_number(tokens, token) });
+				break;
+			case TOKEN_STRING: {
+				TokenPosition at = find_position(parser, token);
+				return (ParseExprResult){ false, { .error = {
+					strdup("Math cannot be done with strings"), at.line, at.column, -1
+				} } };
+			}
+			case TOKEN_UNARY_OP: {
+				char op = token_char(tokens, token);
+				frame->awaiting = AWAIT_NEGATE;
+				frame->op = op;
+				if (!push_frame(parser, &depth, get_binding_power(type, op).right))
+					return too_deep_error(parser, token);
+				continue;
+			}
+			case TOKEN_OPEN_PAREN:
+				frame->awaiting = AWAIT_PAREN;
+				frame->token = token;
+				if (!push_frame(parser, &depth, 0)) return too_deep_error(parser, token);
+				continue;
+			case TOKEN_NAME: {
+				Symbol symbol = token_symbol(tokens, token);
+
+				if (peek_type(parser, 0) == TOKEN_OPEN_PAREN) {
+					parser->next++; // consume open paren
+
+					// arguments can't be strings and don't keep their delimiters
+					frame->awaiting = AWAIT_ARGUMENT;
+					frame->token = token;
+					frame->args = empty_expr_list(parser->arena, false);
+					if (!push_frame(parser, &depth, 0)) return too_deep_error(parser, token);
+					continue;
+				} else if (symbol_is_string(parser->symbols, symbol)) {
+					TokenPosition at = find_position(parser, token);
 					return (ParseExprResult){ false, { .error = {
-						strdup("Expected closing parenthesis"),
-						previous_token->line, token.column, previous_token->column
+						strdup("Math cannot be done with strings"), at.line, at.column, -1
 					} } };
 				}
 
-				lhs = expr_result.result.expr;
+				frame->lhs = push_expr_node(parser->exprs, EXPR_VAR, 0, (ExprValue){ .variable = symbol });
 				break;
-			} else return expr_result;
+			}
+			default: {
+				TokenPosition at = find_position(parser, token);
+				char *error_msg = join_message("Unexpected token: ", stringify_token_type(type));
+				return (ParseExprResult){ false, { .error = { error_msg, at.line, at.column, -1 } } };
+			}
 		}
-		case TOKEN_NAME: {
-			TokenResult open_paren = peek_token(lexer);
 
-			if (open_paren.success && open_paren.result.token.type == TOKEN_OPEN_PAREN) {
-				next_token(lexer); // consume open paren
+		// continually try to parse more operators, until the frame on top has
+		// to wait for an rhs or there are no frames left
+		while (true) {
+			size_t op = peek_index(parser, 0);
+			TokenType op_type = tokens->types[op];
+			bool finished = token_ends_expr(op_type);
+
+			if (!finished) {
+				if (op_type != TOKEN_BINARY_OP && op_type != TOKEN_COMPARISON && op_type != TOKEN_ASSIGN) {
+					parser->next = op + 1; // consume the operator so it's out of the way for whatever we parse next
+					TokenPosition at = find_position(parser, op);
+					char *error_msg = join_message("Expected BINARY_OP, received ", stringify_token_type(op_type));
+					return (ParseExprResult){ false, { .error = { error_msg, at.line, at.column, -1 } } };
+				}
 
-				// the falses here disable storing delimiters and allowing string expressions
-				ParseExprListResult args_result = parse_expr_list(lexer, false, false);
+				BindingPower binding_power = get_binding_power(op_type, token_char(tokens, op));
+				finished = binding_power.left < frame->min_binding_power;
 
-				if (args_result.success) {
-					TokenResult closing_paren = next_token(lexer);
+				if (!finished) {
+					// now that we know we're actually going to parse this operator
+					// (because of the check above) we can consume it and parse the rhs
+					parser->next = op + 1;
 
-					if (!closing_paren.success || closing_paren.result.token.type != TOKEN_CLOSE_PAREN) {
-						free_expr_list(args_result.result.exprs);
-						Token *previous_token = get_most_recent_token(lexer);
-						return (ParseExprResult){ false, { .error = {
-							strdup("Expected closing parenthesis"),
-							previous_token->line, token.column, previous_token->column
-						} } };
-					}
+					// make sure there are more tokens before starting on it
+					if (token_ends_expr(peek_type(parser, 0)))
+						return expected_expression_error(parser);
 
-					lhs = (Expr){ EXPR_CALL, { .call = {
-						.name_string = token.string_literal, .args = args_result.result.exprs
+					frame->awaiting = AWAIT_RHS;
+					frame->op = token_char(tokens, op);
+					if (!push_frame(parser, &depth, binding_power.right))
+						return too_deep_error(parser, peek_index(parser, 0));
+					break;
+				}
+			}
+
+			// the expression on top is done, so hand it to the one underneath
+			ExprIndex expr = frame->lhs;
+			if (--depth == 0) return (ParseExprResult){ true, { .expr = expr } };
+			frame = &parser->frames[depth - 1];
+
+			if (frame->awaiting == AWAIT_NEGATE) {
+				// the operand is already in the pool so the negation just goes after it
+				frame->lhs = push_expr_node(parser->exprs, EXPR_NEGATE, frame->op, (ExprValue){ 0 });
+			} else if (frame->awaiting == AWAIT_RHS) {
+				// the rhs was the last thing to go in the pool so only the lhs needs remembering
+				frame->lhs = push_expr_node(parser->exprs, EXPR_BINARY, frame->op, (ExprValue){ .lhs = frame->lhs });
+			} else if (frame->awaiting == AWAIT_PAREN) {
+				if (tokens->types[advance(parser)] != TOKEN_CLOSE_PAREN)
+					return closing_paren_error(parser, frame->token);
+
+				frame->lhs = expr;
+			} else {
+				push_expr(parser->arena, frame->args, expr);
+
+				if (!token_ends_expr_list(peek_type(parser, 0))) {
+					advance(parser); // the delimiter
+					if (!push_frame(parser, &depth, 0)) return too_deep_error(parser, peek_index(parser, 0));
+					break;
+				}
+
+				if (tokens->types[advance(parser)] != TOKEN_CLOSE_PAREN)
+					return closing_paren_error(parser, frame->token);
+
+				// functions are all built in so we can resolve calls straight away
+				char *name = symbol_name(parser->symbols, token_symbol(tokens, frame->token));
+				int builtin = find_builtin(name);
+				char *error_msg = NULL;
+
+				if (builtin == -1) {
+					error_msg = join_message("Unknown function ", name);
+				} else if (builtins[builtin].arity != frame->args->length) {
+					StringBuilder message = new_string_builder(32);
+					builder_append_str(&message, name);
+					builder_append_str(&message, " expects ");
+					builder_append_number(&message, builtins[builtin].arity);
+					builder_append_str(&message, " argument(s)");
+					error_msg = message.chars;
+				}
+
+				if (error_msg != NULL) {
+					TokenPosition at = find_position(parser, frame->token);
+					return (ParseExprResult){ false, { .error = {
+						error_msg, at.line, at.column, -1
 					} } };
-				} else return (ParseExprResult){ false, { .error = args_result.result.error } };
-			} else lhs = (Expr){ EXPR_VAR, { .variable = token.string_literal } };
+				}
 
-			break;
-		}
-		default: {
-			char *error_msg = strdup("Unexpected token: ");
-			append_str(&error_msg, stringify_token_type(token.type));
-			return (ParseExprResult){ false, { .error = { error_msg, token.line, token.column, -1 } } };
+				// every builtin takes one argument, which is the node just before
+				frame->lhs = push_expr_node(parser->exprs, EXPR_BUILTIN, builtin, (ExprValue){ 0 });
+			}
 		}
 	}
+}
+
+ParseExprListResult parse_expr_list(Parser *parser, bool allow_string, bool store_delimiters) {
+	TokenStream *tokens = parser->tokens;
+	ExprList *exprs = empty_expr_list(parser->arena, store_delimiters);
 
-	// continually try to parse more operators
 	while (true) {
-		TokenResult token_result = peek_token(lexer);
-		if (!token_result.success || token_ends_expr(token_result)) break;
-		
-		Token op = token_result.result.token;
-
-		if (op.type != TOKEN_BINARY_OP) {
-			next_token(lexer); // consume the operator so it's out of the way for whatever we parse next
-			free_expr(lhs);
-			char *error_msg = strdup("Expected BINARY_OP, received ");
-			append_str(&error_msg, stringify_token_type(op.type));
-			return (ParseExprResult){ false, { .error = { error_msg, op.line, op.column, -1 } } };
-		}
+		ParseExprResult expr_result = parse_expr(parser, allow_string);
 
-		BindingPower binding_power = get_binding_power(op);
+		if (expr_result.success) push_expr(parser->arena, exprs, expr_result.result.expr);
+		else {
+			return (ParseExprListResult){ false, { .error = expr_result.result.error } };
+		}
 
-		if (binding_power.left < min_binding_power)
-			break;
+		TokenType type = peek_type(parser, 0);
+		if (token_ends_expr_list(type)) break;
 
-		// now that we know we're actually going to parse this operator (because of
-		// the check above) we can consume the operator and parse the rhs
-		next_token(lexer);
-		
-		// make sure there are more tokens before we recurse
-		TokenResult next_token_result = peek_token(lexer);
-		if (!next_token_result.success || token_ends_expr(next_token_result)) {
-			free_expr(lhs);
-			return expected_expression_error(lexer);
+		// two expressions with nothing between them, like PRINT "A" 1
+		if (type != TOKEN_COMMA && type != TOKEN_SEMICOLON) {
+			TokenPosition at = find_position(parser, peek_index(parser, 0));
+			return (ParseExprListResult){ false, { .error = {
+				strdup("Expected , or ;"), at.line, at.column, -1
+			} } };
 		}
 
-		// find out what the right hand side of the current operator is
-		ParseExprResult rhs_result = parse_math_expr(lexer, binding_power.right);
-		Expr rhs;
+		size_t delimiter = advance(parser);
+		if (store_delimiters) {
+			exprs->delimiters[exprs->delimiters_length++] = token_char(tokens, delimiter);
 
-		if (rhs_result.success) 
-			rhs = rhs_result.result.expr;
-		else {
-			free_expr(lhs);
-			return rhs_result;
+			// lists with stored delimiters (i.e. in a print statement) are allowed
+			// to end with one, in which case there's one delimiter per expression
+			if (token_ends_expr(peek_type(parser, 0))) break;
 		}
+	}
+
+	return (ParseExprListResult){ true, { .exprs = exprs } };
+}
+
+ParseStatementResult parse_assignment(Parser *parser, size_t variable) {
+	TokenStream *tokens = parser->tokens;
+	size_t assign = advance(parser);
+
+	if (tokens->types[assign] != TOKEN_ASSIGN) {
+		if (tokens->types[assign] == TOKEN_ERROR)
+			return (ParseStatementResult){ false, { .error = token_error(parser, assign) } };
+
+		TokenPosition at = find_position(parser, assign);
+		return (ParseStatementResult){ false, { .error = {
+			strdup("Expected '=' after variable name"), at.line, at.column, -1
+		} } };
+	}
+
+	Symbol symbol = token_symbol(tokens, variable);
+	bool is_string = symbol_is_string(parser->symbols, symbol);
+	ParseExprResult expr_result = parse_expr(parser, is_string);
+
+	if (!expr_result.success) {
+		return (ParseStatementResult){ false, { .error = expr_result.result.error } };
+	}
 
-		// update the left hand side to be the expression we've just parsed
-		lhs = (Expr){ EXPR_CALL, { .call = {
-			.name_char = op.char_literal,
-			.args = new_expr_list_from(2, lhs, rhs)
+	if (is_string && !expr_is_string(parser->exprs, expr_result.result.expr, parser->symbols)) {
+		TokenPosition at = find_position(parser, variable);
+		return (ParseStatementResult){ false, { .error = {
+			strdup("A string variable can only be assigned a string"), at.line, at.column, -1
 		} } };
 	}
 
-	// the expression will bulid up in lhs; return that at the end
-	return (ParseExprResult){ true, { .expr = lhs } };
+	return (ParseStatementResult){ true, { .statement = {
+		STATEMENT_ASSIGNMENT, { .assignment = {
+			symbol, expr_result.result.expr
+		} }
+	} } };
 }
 
-ParseExprListResult parse_expr_list(Lexer *lexer, bool allow_string, bool store_delimiters) {
-	ExprList *exprs = empty_expr_list(store_delimiters);
+ParseStatementResult parse_print(Parser *parser) {
+	TokenType next = peek_type(parser, 0);
+	ExprList *exprs;
+
+	// print on its own just prints an empty line
+	if (next != TOKEN_ERROR && token_ends_expr(next)) {
+		exprs = empty_expr_list(parser->arena, true);
+	} else {
+		ParseExprListResult exprs_result = parse_expr_list(parser, true, true);
+
+		if (!exprs_result.success)
+			return (ParseStatementResult){ false, { .error = exprs_result.result.error } };
 
+		exprs = exprs_result.result.exprs;
+	}
+
+	return (ParseStatementResult){ true, { .statement = {
+		STATEMENT_PRINT, { .print = exprs }
+	} } };
+}
+
+ParseStatementResult parse_line_number(Parser *parser, size_t token) {
+	double number = token_number(parser->tokens, token);
+	TokenPosition at = find_position(parser, token);
+
+	if (number != floor(number) || number > UINT32_MAX) {
+		return (ParseStatementResult){ false, { .error = {
+			strdup("A line number has to be a whole number below 2^32"), at.line, at.column, -1
+		} } };
+	}
+
+	return (ParseStatementResult){ true, { .statement = {
+		STATEMENT_LABEL, { .label = { number, at.line, at.column } }
+	} } };
+}
+
+ParseStatementResult parse_jump(Parser *parser, TokenType keyword) {
+	size_t target = advance(parser);
+	TokenType type = parser->tokens->types[target];
+
+	if (type == TOKEN_ERROR)
+		return (ParseStatementResult){ false, { .error = token_error(parser, target) } };
+
+	if (type != TOKEN_NUMBER) {
+		TokenPosition at = find_position(parser, target);
+		char *error_msg = join_message("Expected a line number after ", stringify_token_type(keyword));
+		return (ParseStatementResult){ false, { .error = { error_msg, at.line, at.column, -1 } } };
+	}
+
+	ParseStatementResult result = parse_line_number(parser, target);
+	if (!result.success) return result;
+
+	LineNumber line_number = result.result.statement.statement.label;
+	return (ParseStatementResult){ true, { .statement = {
+		keyword == TOKEN_GOTO ? STATEMENT_GOTO : STATEMENT_GOSUB, { .jump = line_number }
+	} } };
+}
+
+// strings can only be compared with each other, and only at the top of a
+// condition (the result is a number so it can't go any further)
+ParseExprResult parse_condition(Parser *parser) {
+	TokenStream *tokens = parser->tokens;
+	ParseExprResult lhs_result = parse_expr(parser, true);
+
+	if (!lhs_result.success || !expr_is_string(parser->exprs, lhs_result.result.expr, parser->symbols))
+		return lhs_result;
+
+	size_t op = advance(parser);
+	TokenType type = tokens->types[op];
+
+	if (type == TOKEN_ERROR)
+		return (ParseExprResult){ false, { .error = token_error(parser, op) } };
+
+	if (type != TOKEN_COMPARISON && type != TOKEN_ASSIGN) {
+		TokenPosition at = find_position(parser, op);
+		return (ParseExprResult){ false, { .error = {
+			strdup("Expected a comparison after a string"), at.line, at.column, -1
+		} } };
+	}
+
+	ParseExprResult rhs_result = parse_expr(parser, true);
+	if (!rhs_result.success) return rhs_result;
+
+	if (!expr_is_string(parser->exprs, rhs_result.result.expr, parser->symbols)) {
+		TokenPosition at = find_position(parser, op);
+		return (ParseExprResult){ false, { .error = {
+			strdup("A string can only be compared with another string"), at.line, at.column, -1
+		} } };
+	}
+
+	return (ParseExprResult){ true, { .expr = push_expr_node(
+		parser->exprs, EXPR_BINARY, token_char(tokens, op), (ExprValue){ .lhs = lhs_result.result.expr }
+	) } };
+}
+
+ParseStatementResult parse_if(Parser *parser) {
+	TokenStream *tokens = parser->tokens;
+	Statement first = { .type = STATEMENT_IF };
+	Statement *current = &first;
+
+	// an IF straight after THEN goes round again rather than recursing, so a
+	// long chain of them can't overflow the stack
 	while (true) {
-		ParseExprResult expr_result = parse_expr(lexer, allow_string);
+		ParseExprResult condition_result = parse_condition(parser);
 
-		if (expr_result.success) push_expr(exprs, expr_result.result.expr);
-		else {
-			free_expr_list(exprs);
-			return (ParseExprListResult){ false, { .error = expr_result.result.error } };
+		if (!condition_result.success)
+			return (ParseStatementResult){ false, { .error = condition_result.result.error } };
+
+		current->statement.if_then.condition = condition_result.result.expr;
+		size_t then_token = advance(parser);
+
+		if (tokens->types[then_token] == TOKEN_ERROR)
+			return (ParseStatementResult){ false, { .error = token_error(parser, then_token) } };
+
+		if (tokens->types[then_token] != TOKEN_THEN) {
+			TokenPosition at = find_position(parser, then_token);
+			return (ParseStatementResult){ false, { .error = {
+				strdup("Expected THEN after the condition"), at.line, at.column, -1
+			} } };
+		}
+
+		// THEN followed by a line number is short for THEN GOTO
+		size_t target = peek_index(parser, 0);
+		TokenType target_type = tokens->types[target];
+		TokenPosition at = find_position(parser, target);
+		ParseStatementResult then;
+
+		if (target_type == TOKEN_IF) {
+			parser->next = target + 1;
+
+			Statement *nested = arena_alloc(parser->arena, sizeof(Statement));
+			*nested = (Statement){ .type = STATEMENT_IF, .line = at.line, .column = at.column };
+			current->statement.if_then.then = nested;
+			current = nested;
+			continue;
+		} else if (target_type == TOKEN_NUMBER) {
+			then = parse_jump(parser, TOKEN_GOTO);
+
+			if (then.success) {
+				then.result.statement.line = at.line;
+				then.result.statement.column = at.column;
+			}
+		} else if (target_type == TOKEN_NEWLINE || target_type == TOKEN_EOF) {
+			return (ParseStatementResult){ false, { .error = {
+				strdup("Expected a statement after THEN"), at.line, at.column, -1
+			} } };
+		} else {
+			then = parse_statement(parser);
 		}
 
-		if (token_ends_expr_list(peek_token(lexer))) break;
+		if (!then.success) return then;
+
+		Statement *statement = arena_alloc(parser->arena, sizeof(Statement));
+		*statement = then.result.statement;
+		current->statement.if_then.then = statement;
+
+		return (ParseStatementResult){ true, { .statement = first } };
+	}
+}
+
+// parses the statement that starts with token
+static ParseStatementResult parse_statement_from(Parser *parser, size_t token) {
+	TokenStream *tokens = parser->tokens;
+	TokenType type = tokens->types[token];
+
+	switch (type) {
+		case TOKEN_LET: {
+			size_t variable = advance(parser);
+
+			if (tokens->types[variable] == TOKEN_ERROR)
+				return (ParseStatementResult){ false, { .error = token_error(parser, variable) } };
 
-		TokenResult delimiter_result = next_token(lexer);
-		if (store_delimiters && delimiter_result.success) {
-			char delimiter_char = delimiter_result.result.token.char_literal;
-			buffered_string_append_char(&exprs->delimiters, delimiter_char);
+			if (tokens->types[variable] != TOKEN_NAME) {
+				TokenPosition at = find_position(parser, variable);
+				return (ParseStatementResult){ false, { .error = {
+					strdup("Expected variable name after LET"), at.line, at.column, -1
+				} } };
+			}
+
+			return parse_assignment(parser, variable);
+		}
+		// LET is optional so a statement can also start with the variable name
+		case TOKEN_NAME: return parse_assignment(parser, token);
+		case TOKEN_PRINT: return parse_print(parser);
+		case TOKEN_NUMBER: return parse_line_number(parser, token);
+		case TOKEN_GOTO:
+		case TOKEN_GOSUB: return parse_jump(parser, type);
+		case TOKEN_IF: return parse_if(parser);
+		case TOKEN_RETURN: return (ParseStatementResult){ true, { .statement = { .type = STATEMENT_RETURN } } };
+		case TOKEN_END: return (ParseStatementResult){ true, { .statement = { .type = STATEMENT_END } } };
+		default: {
+			TokenPosition at = find_position(parser, token);
+			char *error_msg = join_message("Unexpected token: ", stringify_token_type(type));
+			return (ParseStatementResult){ false, { .error = {
+				error_msg, at.line, at.column, -1
+			} } };
 		}
 	}
+}
 
-	return (ParseExprListResult){ true, { .exprs = exprs } };
+ParseStatementResult parse_statement(Parser *parser) {
+	size_t token = advance(parser);
+
+	if (parser->tokens->types[token] == TOKEN_ERROR)
+		return (ParseStatementResult){ false, { .error = token_error(parser, token) } };
+
+	// found before parsing the rest, which only finds positions after this one
+	TokenPosition at = find_position(parser, token);
+	ParseStatementResult result = parse_statement_from(parser, token);
+
+	if (result.success) {
+		result.result.statement.line = at.line;
+		result.result.statement.column = at.column;
+	}
+
+	return result;
 }
 
-ParserResult parse(char *code) {
-	Lexer *lexer = new_lexer(code, 3);
-	AST ast = new_ast();
+size_t max_errors = DEFAULT_MAX_ERRORS;
 
-	ParseExprListResult e = parse_expr_list(lexer, true, true);
-	if (e.success) {
-		print_expr_list(e.result.exprs);
-		printf("\n");
-		free_expr_list(e.result.exprs);
-	} else {
-		printf("%s\n", e.result.error.message);
-		free(e.result.error.message);
+bool add_error(ErrorList *errors, size_t *capacity, Error error) {
+	if (max_errors != 0 && errors->length >= max_errors) {
+		free(error.message);
+		errors->truncated = true;
+		return false;
 	}
 
-	free_lexer(lexer);
+	if (errors->length == *capacity) {
+		*capacity = *capacity == 0 ? 8 : *capacity * 2;
+		errors->errors = realloc(errors->errors, sizeof(Error) * *capacity);
+		ensure_alloc(errors->errors);
+		count_alloc(STATS_PARSER, sizeof(Error) * *capacity);
+	}
+
+	errors->errors[errors->length++] = error;
+	return true;
+}
+
+// skips whatever's left of the line an error was on, so parsing can carry on
+// from the statement on the next line. the newline may already have been
+// consumed by whatever went wrong, in which case there's nothing to skip
+static void skip_to_next_line(Parser *parser, size_t line) {
+	while (true) {
+		size_t token = peek_index(parser, 0);
+		if (parser->tokens->types[token] == TOKEN_EOF || find_position(parser, token).line > line) return;
+		parser->next = token + 1;
+	}
+}
+
+// parses statements until the end of the input, taking ownership of the token
+// stream. after an error it picks up again at the next line so that every
+// error in the program can be reported at once
+static ParserResult parse_program(TokenStream *tokens, AST *ast) {
+	Parser parser = { tokens, 0, 0, &ast->arena, &ast->exprs, &ast->symbols, NULL, 0 };
+	ErrorList errors = { NULL, 0, false };
+	size_t errors_capacity = 0;
+
+	while (true) {
+		// once everything that's been lexed has been parsed the stream can be
+		// emptied, which keeps a streamed program down to a line at a time
+		if (parser.next == tokens->length && !tokens->complete) {
+			reset_token_stream(tokens);
+			parser.next = 0;
+		}
+
+		size_t token = peek_index(&parser, 0);
+		TokenType type = tokens->types[token];
+		Error error;
+
+		if (type == TOKEN_ERROR) {
+			error = token_error(&parser, token);
+			if (!add_error(&errors, &errors_capacity, error)) break;
+			skip_to_next_line(&parser, error.line);
+			continue;
+		}
+
+		// skip blank lines
+		if (type == TOKEN_NEWLINE) {
+			parser.next = token + 1;
+			continue;
+		}
+
+		if (type == TOKEN_EOF) break;
+
+		ParseStatementResult statement_result = parse_statement(&parser);
+
+		if (!statement_result.success) {
+			error = statement_result.result.error;
+			if (!add_error(&errors, &errors_capacity, error)) break;
+			skip_to_next_line(&parser, error.line);
+			continue;
+		}
+
+		Statement statement = statement_result.result.statement;
+		push_statement(ast, statement);
+
+		// a line number is followed by the statement on the rest of its line,
+		// if there is one
+		if (statement.type == STATEMENT_LABEL) {
+			TokenType rest = peek_type(&parser, 0);
+			if (rest != TOKEN_ERROR && rest != TOKEN_NUMBER) continue;
+		}
+
+		// every statement has to be on its own line
+		size_t end = advance(&parser);
+		TokenType end_type = tokens->types[end];
+
+		if (end_type == TOKEN_NEWLINE) continue;
+		if (end_type == TOKEN_EOF) break;
+
+		if (end_type == TOKEN_ERROR) error = token_error(&parser, end);
+		else {
+			TokenPosition at = find_position(&parser, end);
+			error = (Error){ strdup("Expected end of line"), at.line, at.column, -1 };
+		}
+
+		if (!add_error(&errors, &errors_capacity, error)) break;
+		skip_to_next_line(&parser, error.line);
+	}
+
+	free(parser.frames);
+	free_token_stream(tokens);
+
+	if (errors.length > 0) {
+		free_ast(*ast);
+		return (ParserResult){ false, { .errors = errors } };
+	}
 
 	return (ParserResult){
 		true,
-		{ .ast = ast }
+		{ .ast = *ast }
 	};
 }
+
+ParserResult parse(char *code) {
+	double start = start_phase();
+	AST ast = new_ast();
+
+	// the lexer only has to remember the last token (to tell a binary - from a
+	// unary one) since the parser looks ahead in the stream instead
+	TokenStream tokens = new_token_stream(new_lexer(code, 1, &ast.symbols));
+	ParserResult result = parse_program(&tokens, &ast);
+	end_phase(PHASE_PARSE, start);
+	return result;
+}
+
+ParserResult parse_range(char *code, size_t start, size_t end) {
+	AST ast = new_ast();
+	Lexer *lexer = new_lexer(code, 1, &ast.symbols);
+	lexer->current_index = start;
+	lexer->column_start = start;
+	lexer->code_end = end;
+
+	TokenStream tokens = new_token_stream(lexer);
+	return parse_program(&tokens, &ast);
+}
+
+ParserResult parse_stream(int input_fd, size_t window_capacity) {
+	double start = start_phase();
+	AST ast = new_ast();
+	TokenStream tokens = new_token_stream(new_streaming_lexer(input_fd, window_capacity, 1, &ast.symbols));
+	ParserResult result = parse_program(&tokens, &ast);
+	end_phase(PHASE_PARSE, start);
+	return result;
+}
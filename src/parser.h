@@ -2,65 +2,148 @@
 #define INCLUDE_PARSER_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "lexer.h"
+#include "arena.h"
+#include "symbols.h"
 #include "utils.h"
 
-struct ExprList;
+// expressions are stored as a structure of arrays in post-order, so every
+// node comes straight after its operands and a whole expression is one
+// contiguous run of nodes ending at its root. compiling one is then a single
+// sweep from left to right
+typedef uint32_t ExprIndex;
+
+typedef enum {
+	EXPR_NUMBER,
+	EXPR_STRING,
+	EXPR_VAR,
+	EXPR_NEGATE, // operand is the node before
+	EXPR_BINARY, // rhs is the node before, lhs is in value.lhs
+	EXPR_BUILTIN, // argument is the node before
+	EXPR_CONCAT // joins two strings, laid out like EXPR_BINARY with op '+'
+} ExprKind;
+
+typedef union {
+	double number;
+	uint32_t string; // index into the pool's strings
+	Symbol variable;
+	ExprIndex lhs;
+} ExprValue;
 
 typedef struct {
-	enum {
-		EXPR_NUMBER,
-		EXPR_STRING,
-		EXPR_VAR,
-		EXPR_CALL
-	} type;
-	union {
-		char *number_literal;
-		char *string_literal;
-		char *variable;
-		struct {
-			char *name_string;
-			char name_char;
-			struct ExprList *args;
-		} call;
-	} expr;
-} Expr;
+	uint8_t *kinds;
+	uint8_t *ops; // the operator char, or the index into builtins
+	ExprValue *values;
+	size_t length;
+	size_t capacity;
+	StringSlice *strings; // may point straight into the code
+	size_t strings_length;
+	size_t strings_capacity;
+} ExprPool;
+
+extern ExprPool new_expr_pool(void);
+extern void free_expr_pool(ExprPool *pool);
+extern ExprIndex push_expr_node(ExprPool *pool, ExprKind kind, uint8_t op, ExprValue value);
+extern ExprIndex push_string_node(ExprPool *pool, StringSlice string);
 
-extern void free_expr(Expr expr);
+// the index of the first node of the expression whose root is at index
+extern ExprIndex expr_start(ExprPool *pool, ExprIndex index);
 
-typedef struct ExprList {
-	Expr *exprs;
+typedef struct {
+	ExprIndex *exprs;
 	size_t length;
+	size_t capacity;
 	bool store_delimiters;
-	BufferedString delimiters;
+	char *delimiters;
+	size_t delimiters_length;
 } ExprList;
 
-extern ExprList *new_expr_list_from(size_t length, ...);
-extern ExprList *empty_expr_list(bool store_delimiters);
-extern void push_expr(ExprList *exprs, Expr expr);
-extern void free_expr_list(ExprList *exprs);
+// lists are allocated in the ast's arena so there's nothing to free
+extern ExprList *empty_expr_list(Arena *arena, bool store_delimiters);
+extern void push_expr(Arena *arena, ExprList *exprs, ExprIndex expr);
 
+// a line number written in the program, along with where it was written so
+// errors about it can point to it
 typedef struct {
+	uint32_t number;
+	uint32_t line, column;
+} LineNumber;
+
+// lines are run in the order they're written, so a line number is just a
+// label for the statements after it
+typedef struct Statement {
 	enum {
 		STATEMENT_ASSIGNMENT,
-		STATEMENT_PRINT
+		STATEMENT_PRINT,
+		STATEMENT_LABEL,
+		STATEMENT_GOTO,
+		STATEMENT_GOSUB,
+		STATEMENT_RETURN,
+		STATEMENT_IF,
+		STATEMENT_END
 	} type;
 	union {
 		struct {
-			char *variable;
-			Expr expr;
+			Symbol variable;
+			ExprIndex expr;
 		} assignment;
 		ExprList *print;
+		LineNumber label;
+		LineNumber jump; // for GOTO and GOSUB
+		struct {
+			ExprIndex condition;
+			struct Statement *then; // in the arena
+		} if_then;
 	} statement;
+	uint32_t line, column; // where the statement starts, for the profiler
 } Statement;
 
 typedef struct {
 	Statement *statements;
 	size_t length;
+	size_t capacity;
+	ExprPool exprs;
+	Arena arena; // owns everything else in the ast
+	SymbolTable symbols;
 } AST;
 
 extern AST new_ast(void);
+extern void push_statement(AST *ast, Statement statement);
+extern void free_ast(AST ast);
+
+// why an expression on the parser's stack is waiting for the one above it
+typedef enum {
+	AWAIT_NEGATE,
+	AWAIT_PAREN,
+	AWAIT_ARGUMENT, // of a call to a builtin
+	AWAIT_RHS
+} ExprAwait;
+
+// expressions are parsed with a stack of these on the heap rather than by
+// recursing, so nesting them deeply can't overflow the real stack. each is
+// an expression that's part way through being parsed
+typedef struct {
+	uint8_t min_binding_power;
+	uint8_t awaiting; // an ExprAwait
+	char op; // the operator waiting for its operand
+	size_t token; // where the parenthesis or call started, for errors
+	ExprIndex lhs;
+	ExprList *args;
+} ExprFrame;
+
+typedef struct {
+	TokenStream *tokens;
+	size_t next; // the index in tokens of the next token
+	size_t line_index; // the line in tokens that the last position was found on
+	Arena *arena;
+	ExprPool *exprs;
+	SymbolTable *symbols;
+
+	ExprFrame *frames; // reused for every expression
+	size_t frames_capacity;
+} Parser;
 
 typedef struct {
 	uint8_t left;
@@ -70,7 +153,7 @@ typedef struct {
 typedef struct {
 	bool success;
 	union {
-		Expr expr;
+		ExprIndex expr;
 		Error error;
 	} result;
 } ParseExprResult;
@@ -83,11 +166,30 @@ typedef struct {
 	} result;
 } ParseExprListResult;
 
+typedef struct {
+	bool success;
+	union {
+		Statement statement;
+		Error error;
+	} result;
+} ParseStatementResult;
+
 typedef struct {
 	Error *errors;
 	size_t length;
+	bool truncated; // an error was left out because max_errors had been reached
 } ErrorList;
 
+extern void free_error_list(ErrorList errors);
+
+// adds an error to the list. if it already has as many as max_errors allows
+// the error is freed instead, the list marked truncated and false returned
+extern bool add_error(ErrorList *errors, size_t *capacity, Error error);
+
+// prints an error along with the line it happened on, underlining the part of
+// the line that's wrong. code can be NULL if it isn't around any more
+extern void print_error(FILE *out, Error error, char *code);
+
 typedef struct {
 	bool success;
 	union {
@@ -96,20 +198,51 @@ typedef struct {
 	} result;
 } ParserResult;
 
-extern ParseExprResult expected_expression_error(Lexer *lexer);
-extern ParseExprResult parse_expr(Lexer *lexer, bool allow_string);
+extern bool expr_is_string(ExprPool *pool, ExprIndex expr, SymbolTable *symbols);
+
+extern char *join_message(const char *before, const char *after);
+extern Error token_error(Parser *parser, size_t token);
+extern ParseExprResult expected_expression_error(Parser *parser);
+extern ParseExprResult parse_expr(Parser *parser, bool allow_string);
 
-extern BindingPower get_binding_power(Token token);
-extern bool token_ends_expr(TokenResult token_result);
-extern bool token_ends_expr_list(TokenResult token_result);
-extern ParseExprResult parse_math_expr(Lexer *lexer, uint8_t min_binding_power);
+extern BindingPower get_binding_power(TokenType type, char op);
+extern bool token_ends_expr(TokenType type);
+extern bool token_ends_expr_list(TokenType type);
+extern ParseExprResult parse_math_expr(Parser *parser, uint8_t min_binding_power);
 
 extern ParseExprListResult parse_expr_list(
-	Lexer *lexer,
+	Parser *parser,
 	bool allow_string,
 	bool store_delimiters
 );
 
+extern ParseStatementResult parse_assignment(Parser *parser, size_t variable);
+extern ParseStatementResult parse_print(Parser *parser);
+extern ParseStatementResult parse_line_number(Parser *parser, size_t token);
+extern ParseStatementResult parse_jump(Parser *parser, TokenType keyword);
+extern ParseExprResult parse_condition(Parser *parser);
+extern ParseStatementResult parse_if(Parser *parser);
+extern ParseStatementResult parse_statement(Parser *parser);
+
+// parsing carries on after an error to find the rest, until it's found this
+// many (or forever if it's 0)
+#define DEFAULT_MAX_ERRORS 100
+extern size_t max_errors;
+
+// expressions can't be nested (with parentheses, negation or operators that
+// are still waiting for their rhs) any deeper than this (0 for no limit).
+// nothing recurses over expressions, so this only bounds the memory used
+#define DEFAULT_MAX_DEPTH 100000
+extern size_t max_depth;
+
 extern ParserResult parse(char *code);
 
+// parses just the lines from start up to end, which has to be straight after
+// a newline or the end of the code. line numbers count from the first of them
+extern ParserResult parse_range(char *code, size_t start, size_t end);
+
+// reads the program from a file descriptor a window at a time, so memory for
+// the input is bounded by the window size (or the longest line if that's more)
+extern ParserResult parse_stream(int input_fd, size_t window_capacity);
+
 #endif // INCLUDE_PARSER_H
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "profile.h"
+#include "utils.h"
+
+// how many of the hottest lines and statements the report shows
+#define PROFILE_REPORT_ROWS 20
+
+// how much of a line of source the report shows
+#define PROFILE_SOURCE_WIDTH 48
+
+Profile *active_profile = NULL;
+
+// the profile the timer is sampling, and what SIGALRM did before
+static Profile *sampled_profile = NULL;
+static struct sigaction previous_action;
+
+static void handle_sample(int signal) {
+	(void)signal;
+	sampled_profile->pending++;
+}
+
+Profile *new_profile(Program *program) {
+	Profile *profile = calloc(1, sizeof(Profile));
+	ensure_alloc(profile);
+
+	profile->program = program;
+	profile->statements = calloc(program->statement_lines_length + 1, sizeof(ProfiledStatement));
+	ensure_alloc(profile->statements);
+	profile->current = program->statement_lines_length;
+
+	profile->nodes_capacity = 16;
+	profile->nodes = malloc(sizeof(ProfileNode) * profile->nodes_capacity);
+	ensure_alloc(profile->nodes);
+	profile->nodes[profile->nodes_length++] = (ProfileNode){ 0, program->statement_lines_length, 0, 0 };
+
+	return profile;
+}
+
+void free_profile(Profile *profile) {
+	if (profile == NULL) return;
+
+	free(profile->code);
+	free(profile->statements);
+	free(profile->nodes);
+	free(profile->children.entries);
+	free(profile->paths.entries);
+	free(profile);
+}
+
+Instruction *start_profile(Profile *profile, Instruction *code) {
+	Program *program = profile->program;
+
+	free(profile->code);
+	profile->code = malloc(sizeof(Instruction) * program->length);
+	ensure_alloc(profile->code);
+	memcpy(profile->code, code, sizeof(Instruction) * program->length);
+
+	for (size_t i = 0; i < program->statement_lines_length; i++) {
+		uint32_t offset = program->statement_lines[i].offset;
+		if (offset >= program->length || profile->code[offset].opcode == OP_PROFILE_ENTRY) continue;
+
+		profile->statements[i].first = profile->code[offset];
+		profile->code[offset] = (Instruction){ OP_PROFILE_ENTRY, i };
+	}
+
+	// restarting system calls means a sample landing in the middle of printing
+	// doesn't turn into an error
+	sampled_profile = profile;
+	struct sigaction action = { 0 };
+	action.sa_handler = handle_sample;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGALRM, &action, &previous_action);
+
+	struct timeval interval = { 0, PROFILE_SAMPLE_MICROSECONDS };
+	struct itimerval timer = { interval, interval };
+	setitimer(ITIMER_REAL, &timer, NULL);
+
+	profile->start_seconds = monotonic_seconds();
+	return profile->code;
+}
+
+void stop_profile(Profile *profile) {
+	struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+	setitimer(ITIMER_REAL, &timer, NULL);
+	sigaction(SIGALRM, &previous_action, NULL);
+	sampled_profile = NULL;
+
+	profile->end_seconds = monotonic_seconds();
+	take_samples(profile);
+}
+
+static uint64_t table_key(uint32_t a, uint32_t b) {
+	return ((uint64_t)a + 1) << 32 | b;
+}
+
+static size_t table_index(uint64_t key, size_t capacity) {
+	return (key * 0x9E3779B97F4A7C15ULL >> 32) & (capacity - 1);
+}
+
+// finds the count for key, adding it as 0 if it isn't there yet
+static uint64_t *table_slot(ProfileTable *table, uint64_t key) {
+	// kept at most half full so probes stay short
+	if ((table->length + 1) * 2 > table->capacity) {
+		ProfileTable grown = { NULL, table->length, table->capacity == 0 ? 64 : table->capacity * 2 };
+		grown.entries = calloc(grown.capacity, sizeof(ProfileEntry));
+		ensure_alloc(grown.entries);
+
+		for (size_t i = 0; i < table->capacity; i++) {
+			ProfileEntry entry = table->entries[i];
+			if (entry.key == 0) continue;
+
+			size_t index = table_index(entry.key, grown.capacity);
+			while (grown.entries[index].key != 0) index = (index + 1) & (grown.capacity - 1);
+			grown.entries[index] = entry;
+		}
+
+		free(table->entries);
+		*table = grown;
+	}
+
+	size_t index = table_index(key, table->capacity);
+
+	while (table->entries[index].key != key) {
+		if (table->entries[index].key == 0) {
+			table->entries[index].key = key;
+			table->length++;
+			break;
+		}
+
+		index = (index + 1) & (table->capacity - 1);
+	}
+
+	return &table->entries[index].value;
+}
+
+void take_samples(Profile *profile) {
+	uint64_t samples = __atomic_exchange_n(&profile->pending, 0, __ATOMIC_RELAXED);
+
+	profile->statements[profile->current].samples += samples;
+	profile->samples += samples;
+
+	if (profile->depth > 0)
+		*table_slot(&profile->paths, table_key(profile->stack[profile->depth - 1], profile->current)) += samples;
+}
+
+// the statement that starts at offset, or the one after it if nothing starts
+// there (which is only the halt on the end)
+static uint32_t statement_at(Program *program, uint32_t offset) {
+	size_t low = 0, high = program->statement_lines_length;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (program->statement_lines[middle].offset < offset) low = middle + 1;
+		else high = middle;
+	}
+
+	return low;
+}
+
+void profile_call(Profile *profile, uint32_t target) {
+	if (profile->pending) take_samples(profile);
+
+	if (profile->depth == PROFILE_MAX_DEPTH) {
+		profile->overflow++;
+		return;
+	}
+
+	uint32_t parent = profile->depth == 0 ? 0 : profile->stack[profile->depth - 1];
+
+	// node 0 is never anyone's child, so it means there's nothing cached
+	if (profile->nodes[parent].last_child != 0 && profile->nodes[parent].last_target == target) {
+		profile->stack[profile->depth++] = profile->nodes[parent].last_child;
+		return;
+	}
+
+	uint32_t statement = statement_at(profile->program, target);
+	uint64_t *node = table_slot(&profile->children, table_key(parent, statement));
+
+	if (*node == 0) {
+		if (profile->nodes_length == profile->nodes_capacity) {
+			profile->nodes_capacity *= 2;
+			profile->nodes = realloc(profile->nodes, sizeof(ProfileNode) * profile->nodes_capacity);
+			ensure_alloc(profile->nodes);
+		}
+
+		*node = profile->nodes_length;
+		profile->nodes[profile->nodes_length++] = (ProfileNode){ parent, statement, 0, 0 };
+	}
+
+	profile->nodes[parent].last_target = target;
+	profile->nodes[parent].last_child = *node;
+	profile->stack[profile->depth++] = *node;
+}
+
+void profile_return(Profile *profile) {
+	if (profile->pending) take_samples(profile);
+
+	if (profile->overflow > 0) profile->overflow--;
+	else if (profile->depth > 0) profile->depth--;
+}
+
+// timers can fall behind, so each sample is worth the share of the whole run
+// it was rather than exactly PROFILE_SAMPLE_MICROSECONDS
+static double sample_seconds(Profile *profile) {
+	return profile->samples == 0 ? 0 : (profile->end_seconds - profile->start_seconds) / profile->samples;
+}
+
+typedef struct {
+	uint32_t line, column;
+	uint64_t runs, samples;
+	char *source; // where the line starts in the source
+} ProfileRow;
+
+static int compare_rows_by_line(const void *a, const void *b) {
+	const ProfileRow *lhs = a, *rhs = b;
+	if (lhs->line != rhs->line) return lhs->line < rhs->line ? -1 : 1;
+	return (lhs->column > rhs->column) - (lhs->column < rhs->column);
+}
+
+static int compare_rows_by_time(const void *a, const void *b) {
+	const ProfileRow *lhs = a, *rhs = b;
+	if (lhs->samples != rhs->samples) return lhs->samples > rhs->samples ? -1 : 1;
+	if (lhs->runs != rhs->runs) return lhs->runs > rhs->runs ? -1 : 1;
+	return compare_rows_by_line(a, b);
+}
+
+// finds where each row's line starts in one pass over the source. the rows
+// have to be sorted by line
+static void find_sources(ProfileRow *rows, size_t length, char *source) {
+	char *start = source;
+	uint32_t line = 1;
+
+	for (size_t i = 0; i < length; i++) {
+		while (start != NULL && line < rows[i].line) {
+			start = strchr(start, '\n');
+			if (start != NULL) start++;
+			line++;
+		}
+
+		rows[i].source = start;
+	}
+}
+
+static void print_source(FILE *file, char *source, uint32_t column) {
+	if (source == NULL) {
+		fprintf(file, "\n");
+		return;
+	}
+
+	source += column > 0 ? column - 1 : 0;
+	while (*source == ' ' || *source == '\t') source++;
+
+	size_t length = strcspn(source, "\r\n");
+	if (length > PROFILE_SOURCE_WIDTH) fprintf(file, "%.*s...\n", PROFILE_SOURCE_WIDTH - 3, source);
+	else fprintf(file, "%.*s\n", (int)length, source);
+}
+
+static void print_rows(FILE *file, ProfileRow *rows, size_t length, Profile *profile, bool columns) {
+	double seconds = sample_seconds(profile);
+
+	qsort(rows, length, sizeof(ProfileRow), compare_rows_by_time);
+	if (length > PROFILE_REPORT_ROWS) length = PROFILE_REPORT_ROWS;
+
+	for (size_t i = 0; i < length; i++) {
+		ProfileRow row = rows[i];
+		char position[32];
+
+		if (columns) snprintf(position, sizeof(position), "%u:%u", row.line, row.column);
+		else snprintf(position, sizeof(position), "%u", row.line);
+
+		fprintf(
+			file, "  %10s %12llu %11.3f %6.1f%% %9.0f  ", position, (unsigned long long)row.runs,
+			row.samples * seconds * 1e3, profile->samples == 0 ? 0 : 100.0 * row.samples / profile->samples,
+			row.runs == 0 ? 0 : row.samples * seconds * 1e9 / row.runs
+		);
+		print_source(file, row.source, columns ? row.column : 1);
+	}
+}
+
+void print_profile(FILE *file, Profile *profile, char *source) {
+	Program *program = profile->program;
+	size_t length = program->statement_lines_length;
+	uint64_t runs = 0;
+
+	ProfileRow *statements = malloc(sizeof(ProfileRow) * (length + 1));
+	ensure_alloc(statements);
+
+	for (size_t i = 0; i < length; i++) {
+		StatementLine position = program->statement_lines[i];
+		statements[i] = (ProfileRow){
+			position.line, position.column, profile->statements[i].runs, profile->statements[i].samples, NULL
+		};
+		runs += statements[i].runs;
+	}
+
+	qsort(statements, length, sizeof(ProfileRow), compare_rows_by_line);
+	if (source != NULL) find_sources(statements, length, source);
+
+	// every statement on a line runs when the line does (apart from the one
+	// after THEN), so a line runs as many times as its busiest statement
+	ProfileRow *lines = malloc(sizeof(ProfileRow) * (length + 1));
+	ensure_alloc(lines);
+	size_t lines_length = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		if (lines_length == 0 || lines[lines_length - 1].line != statements[i].line) {
+			lines[lines_length++] = statements[i];
+			continue;
+		}
+
+		ProfileRow *line = &lines[lines_length - 1];
+		line->samples += statements[i].samples;
+		if (statements[i].runs > line->runs) line->runs = statements[i].runs;
+	}
+
+	fprintf(
+		file, "profile: %llu statements run in %.3f ms, %llu samples (one every %d us)\n",
+		(unsigned long long)runs, (profile->end_seconds - profile->start_seconds) * 1e3,
+		(unsigned long long)profile->samples, PROFILE_SAMPLE_MICROSECONDS
+	);
+
+	fprintf(file, "\nhottest lines:\n");
+	fprintf(file, "  %10s %12s %11s %7s %9s  %s\n", "line", "runs", "time (ms)", "time", "ns/run", "source");
+	print_rows(file, lines, lines_length, profile, false);
+
+	fprintf(file, "\nhottest statements:\n");
+	fprintf(file, "  %10s %12s %11s %7s %9s  %s\n", "line:col", "runs", "time (ms)", "time", "ns/run", "statement");
+	print_rows(file, statements, length, profile, true);
+
+	free(lines);
+	free(statements);
+}
+
+static uint32_t statement_line(Program *program, uint32_t statement) {
+	return statement < program->statement_lines_length ? program->statement_lines[statement].line : 0;
+}
+
+static void write_frames(FILE *file, Profile *profile, uint32_t node) {
+	if (node == 0) {
+		fputs("main", file);
+		return;
+	}
+
+	write_frames(file, profile, profile->nodes[node].parent);
+	fprintf(file, ";gosub line %u", statement_line(profile->program, profile->nodes[node].statement));
+}
+
+bool write_folded_stacks(char *path, Profile *profile) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) return false;
+
+	Program *program = profile->program;
+
+	// the main program's share of each statement is whatever the subroutines
+	// didn't have
+	uint64_t *main_samples = malloc(sizeof(uint64_t) * (program->statement_lines_length + 1));
+	ensure_alloc(main_samples);
+
+	for (size_t i = 0; i <= program->statement_lines_length; i++)
+		main_samples[i] = profile->statements[i].samples;
+
+	for (size_t i = 0; i < profile->paths.capacity; i++) {
+		ProfileEntry entry = profile->paths.entries[i];
+		if (entry.key == 0 || entry.value == 0) continue;
+
+		uint32_t node = (entry.key >> 32) - 1, statement = (uint32_t)entry.key;
+		main_samples[statement] -= entry.value;
+
+		write_frames(file, profile, node);
+		fprintf(file, ";line %u %llu\n", statement_line(program, statement), (unsigned long long)entry.value);
+	}
+
+	for (size_t i = 0; i < program->statement_lines_length; i++) {
+		if (main_samples[i] == 0) continue;
+		fprintf(file, "main;line %u %llu\n", statement_line(program, i), (unsigned long long)main_samples[i]);
+	}
+
+	free(main_samples);
+	return fclose(file) == 0;
+}
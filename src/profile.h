@@ -0,0 +1,109 @@
+#ifndef INCLUDE_PROFILE_H
+#define INCLUDE_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <signal.h>
+
+#include "compiler.h"
+
+// the profiler counts how many times each statement runs and samples which
+// one is running to see where the time goes. like the jit, it works on its
+// own copy of the code, with an OP_PROFILE_ENTRY patched over the start of
+// every statement. reading the clock at every statement would cost more than
+// running most of them, so instead a timer goes off every so often and the
+// next entry charges the sample to the statement that was running
+#define PROFILE_SAMPLE_MICROSECONDS 100
+
+// subroutines deeper than this are counted as part of the deepest one
+#define PROFILE_MAX_DEPTH 64
+
+typedef struct {
+	uint64_t runs;
+	uint64_t samples;
+	Instruction first; // the instruction the entry replaced
+} ProfiledStatement;
+
+// a subroutine called from somewhere, for the folded stacks. node 0 is the
+// main program
+typedef struct {
+	uint32_t parent;
+	uint32_t statement; // the first statement of the subroutine
+
+	// the last subroutine called from this one, since a GOSUB in a loop
+	// usually calls the same one every time
+	uint32_t last_target, last_child;
+} ProfileNode;
+
+// an open addressing table from a pair of numbers to a count. keys are never
+// 0, so 0 marks an empty slot
+typedef struct {
+	uint64_t key;
+	uint64_t value;
+} ProfileEntry;
+
+typedef struct {
+	ProfileEntry *entries;
+	size_t length, capacity;
+} ProfileTable;
+
+typedef struct {
+	Program *program;
+	Instruction *code; // the code that was running with the entries patched in
+
+	// one for each of the program's statement lines, plus one on the end for
+	// anything that happens before the first statement
+	ProfiledStatement *statements;
+	uint32_t current;
+	volatile sig_atomic_t pending; // samples taken since the last entry
+	uint64_t samples;
+
+	// the subroutines that are running, and the samples of each statement
+	// from each of them (the main program's are what's left of the total)
+	ProfileNode *nodes;
+	size_t nodes_length, nodes_capacity;
+	uint32_t stack[PROFILE_MAX_DEPTH + 1];
+	size_t depth, overflow;
+	ProfileTable children; // (parent, statement) -> node
+	ProfileTable paths; // (node, statement) -> samples
+
+	double start_seconds, end_seconds;
+} Profile;
+
+// the vm profiles every program it runs while this is set
+extern Profile *active_profile;
+
+extern Profile *new_profile(Program *program);
+extern void free_profile(Profile *profile);
+
+// patches the entries into a copy of code (which may already be the jit's
+// copy) and starts the timer. returns the code to run
+extern Instruction *start_profile(Profile *profile, Instruction *code);
+extern void stop_profile(Profile *profile);
+
+// gives the samples that have come in to the statement that's running. this
+// can't be done in the signal handler since it might have to add to a table
+extern void take_samples(Profile *profile);
+
+static inline void enter_statement(Profile *profile, uint32_t statement) {
+	if (profile->pending) take_samples(profile);
+	profile->current = statement;
+	profile->statements[statement].runs++;
+}
+
+// GOSUB and RETURN keep track of which subroutines are running. target is
+// where the subroutine starts in the code
+extern void profile_call(Profile *profile, uint32_t target);
+extern void profile_return(Profile *profile);
+
+// source can be NULL if it isn't around any more, in which case the lines
+// aren't shown
+extern void print_profile(FILE *file, Profile *profile, char *source);
+
+// writes one line per stack, like "main;gosub line 100;line 120 50", with the
+// number of samples. returns false if the file couldn't be written
+extern bool write_folded_stacks(char *path, Profile *profile);
+
+#endif // INCLUDE_PROFILE_H
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scan.h"
+
+const Scanner *scanner = &scalar_scanner;
+
+static inline bool is_whitespace(char ch) {
+	return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+static size_t scalar_skip_whitespace(char *code, size_t index) {
+	while (is_whitespace(code[index])) index++;
+	return index;
+}
+
+static size_t scalar_find_line_end(char *code, size_t index) {
+	while (code[index] != '\n' && code[index] != '\0') index++;
+	return index;
+}
+
+static size_t scalar_find_string_end(char *code, size_t index) {
+	while (true) {
+		char ch = code[index];
+		if (ch == '"' || ch == '\\' || ch == '\n' || ch == '\0') return index;
+		index++;
+	}
+}
+
+const Scanner scalar_scanner = {
+	"scalar", scalar_skip_whitespace, scalar_find_line_end, scalar_find_string_end
+};
+
+#ifdef HAVE_SIMD_SCANNERS
+
+#include <immintrin.h>
+
+// the simd scanners only ever do aligned loads. an aligned block can't cross
+// a page boundary, so if it has any byte of the code in it then it's safe to
+// read all of it, even the bytes after the null byte. bytes before the
+// starting index are masked off. address sanitizer doesn't know this, so it's
+// turned off for them
+
+#define SCAN_FUNCTION __attribute__((no_sanitize_address))
+
+// each of these expands to a function that scans a block at a time until the
+// mask of interesting bytes in a block isn't empty
+#define DEFINE_SIMD_SCAN(name, isa, vector, width, load, movemask, interesting) \
+	SCAN_FUNCTION __attribute__((target(isa))) \
+	static size_t name(char *code, size_t index) { \
+		char *ptr = code + index; \
+		char *block = (char *)((uintptr_t)ptr & ~(uintptr_t)(width - 1)); \
+		uint32_t skip = ptr - block; \
+		vector bytes = load((vector *)block); \
+		uint32_t mask = (uint32_t)movemask(interesting) >> skip << skip; \
+		while (mask == 0) { \
+			block += width; \
+			bytes = load((vector *)block); \
+			mask = movemask(interesting); \
+		} \
+		return block + __builtin_ctz(mask) - code; \
+	}
+
+#define SSE2_EQ(ch) _mm_cmpeq_epi8(bytes, _mm_set1_epi8(ch))
+#define AVX2_EQ(ch) _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ch))
+
+// for whitespace the interesting bytes are the ones that aren't whitespace
+#define SSE2_NOT_WHITESPACE _mm_xor_si128( \
+	_mm_or_si128(_mm_or_si128(SSE2_EQ(' '), SSE2_EQ('\t')), SSE2_EQ('\r')), \
+	_mm_set1_epi8(-1) \
+)
+#define AVX2_NOT_WHITESPACE _mm256_xor_si256( \
+	_mm256_or_si256(_mm256_or_si256(AVX2_EQ(' '), AVX2_EQ('\t')), AVX2_EQ('\r')), \
+	_mm256_set1_epi8(-1) \
+)
+
+#define SSE2_LINE_END _mm_or_si128(SSE2_EQ('\n'), SSE2_EQ('\0'))
+#define AVX2_LINE_END _mm256_or_si256(AVX2_EQ('\n'), AVX2_EQ('\0'))
+
+#define SSE2_STRING_END _mm_or_si128( \
+	_mm_or_si128(SSE2_EQ('"'), SSE2_EQ('\\')), \
+	_mm_or_si128(SSE2_EQ('\n'), SSE2_EQ('\0')) \
+)
+#define AVX2_STRING_END _mm256_or_si256( \
+	_mm256_or_si256(AVX2_EQ('"'), AVX2_EQ('\\')), \
+	_mm256_or_si256(AVX2_EQ('\n'), AVX2_EQ('\0')) \
+)
+
+DEFINE_SIMD_SCAN(sse2_skip_whitespace_blocks, "sse2", __m128i, 16, _mm_load_si128, _mm_movemask_epi8, SSE2_NOT_WHITESPACE)
+DEFINE_SIMD_SCAN(sse2_find_line_end, "sse2", __m128i, 16, _mm_load_si128, _mm_movemask_epi8, SSE2_LINE_END)
+DEFINE_SIMD_SCAN(sse2_find_string_end, "sse2", __m128i, 16, _mm_load_si128, _mm_movemask_epi8, SSE2_STRING_END)
+
+DEFINE_SIMD_SCAN(avx2_skip_whitespace_blocks, "avx2", __m256i, 32, _mm256_load_si256, _mm256_movemask_epi8, AVX2_NOT_WHITESPACE)
+DEFINE_SIMD_SCAN(avx2_find_line_end, "avx2", __m256i, 32, _mm256_load_si256, _mm256_movemask_epi8, AVX2_LINE_END)
+DEFINE_SIMD_SCAN(avx2_find_string_end, "avx2", __m256i, 32, _mm256_load_si256, _mm256_movemask_epi8, AVX2_STRING_END)
+
+// most runs of whitespace are a single space between tokens, which isn't
+// worth a vector load, so only go wide after a couple of bytes
+static size_t sse2_skip_whitespace(char *code, size_t index) {
+	if (!is_whitespace(code[index])) return index;
+	if (!is_whitespace(code[index + 1])) return index + 1;
+	return sse2_skip_whitespace_blocks(code, index + 2);
+}
+
+static size_t avx2_skip_whitespace(char *code, size_t index) {
+	if (!is_whitespace(code[index])) return index;
+	if (!is_whitespace(code[index + 1])) return index + 1;
+	return avx2_skip_whitespace_blocks(code, index + 2);
+}
+
+const Scanner sse2_scanner = {
+	"sse2", sse2_skip_whitespace, sse2_find_line_end, sse2_find_string_end
+};
+
+const Scanner avx2_scanner = {
+	"avx2", avx2_skip_whitespace, avx2_find_line_end, avx2_find_string_end
+};
+
+// lexers on other threads call this too, so it only writes when the choice
+// actually changes (which is just the first time)
+void select_scanner(void) {
+	__builtin_cpu_init();
+	const Scanner *best = __builtin_cpu_supports("avx2") ? &avx2_scanner : &sse2_scanner;
+	if (scanner != best) scanner = best;
+}
+
+#else
+
+void select_scanner(void) {
+	if (scanner != &scalar_scanner) scanner = &scalar_scanner;
+}
+
+#endif
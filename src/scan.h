@@ -0,0 +1,28 @@
+#ifndef INCLUDE_SCAN_H
+#define INCLUDE_SCAN_H
+
+#include <stddef.h>
+
+// the lexer's inner loops: each takes the index to start at and returns the
+// index of the first byte that needs looking at. they all rely on the code
+// ending in a null byte, which they always stop at
+typedef struct {
+	char *name;
+	size_t (*skip_whitespace)(char *code, size_t index); // past ' ', '\t' and '\r'
+	size_t (*find_line_end)(char *code, size_t index); // to '\n'
+	size_t (*find_string_end)(char *code, size_t index); // to '"', '\\' or '\n'
+} Scanner;
+
+extern const Scanner scalar_scanner;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_SIMD_SCANNERS
+extern const Scanner sse2_scanner;
+extern const Scanner avx2_scanner;
+#endif
+
+// the fastest scanner this cpu supports, set by select_scanner
+extern const Scanner *scanner;
+extern void select_scanner(void);
+
+#endif  // INCLUDE_SCAN_H
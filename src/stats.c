@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+#include "utils.h"
+
+bool stats_enabled = false;
+
+static Stats stats;
+
+void reset_stats(void) {
+	memset(&stats, 0, sizeof(Stats));
+}
+
+static void add_counts(uint64_t *counts, const uint64_t *amounts, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		if (amounts[i] > 0) __atomic_fetch_add(&counts[i], amounts[i], __ATOMIC_RELAXED);
+}
+
+static void copy_counts(uint64_t *copy, uint64_t *counts, size_t length) {
+	for (size_t i = 0; i < length; i++) copy[i] = __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+}
+
+Stats read_stats(void) {
+	Stats copy = { 0 };
+	copy_counts(copy.phase_nanoseconds, stats.phase_nanoseconds, STATS_PHASES);
+	copy_counts(copy.tokens, stats.tokens, TOKEN_TYPES);
+	copy_counts(copy.allocations, stats.allocations, STATS_SUBSYSTEMS);
+	copy_counts(copy.bytes, stats.bytes, STATS_SUBSYSTEMS);
+
+	// linux gives the peak in kilobytes
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) copy.peak_rss = (size_t)usage.ru_maxrss * 1024;
+
+	return copy;
+}
+
+char *stringify_phase(StatsPhase phase) {
+	switch (phase) {
+		case PHASE_READ: return "read source";
+		case PHASE_CACHE: return "cache";
+		case PHASE_PARSE: return "lex + parse";
+		case PHASE_LEX: return "  of which lex";
+		case PHASE_OPTIMISE: return "optimise";
+		case PHASE_COMPILE: return "compile";
+		case PHASE_RUN: return "run";
+	}
+
+	return "unknown";
+}
+
+char *stringify_subsystem(StatsSubsystem subsystem) {
+	switch (subsystem) {
+		case STATS_LEXER: return "lexer";
+		case STATS_PARSER: return "parser";
+		case STATS_AST: return "ast";
+		case STATS_COMPILER: return "compiler";
+		case STATS_RUNTIME: return "runtime";
+	}
+
+	return "unknown";
+}
+
+void record_alloc(StatsSubsystem subsystem, size_t bytes) {
+	__atomic_fetch_add(&stats.allocations[subsystem], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats.bytes[subsystem], bytes, __ATOMIC_RELAXED);
+}
+
+double start_phase(void) {
+	return stats_enabled ? monotonic_seconds() : 0;
+}
+
+void end_phase(StatsPhase phase, double start) {
+	if (stats_enabled) add_phase_time(phase, monotonic_seconds() - start);
+}
+
+void add_phase_time(StatsPhase phase, double seconds) {
+	if (!stats_enabled) return;
+	__atomic_fetch_add(&stats.phase_nanoseconds[phase], (uint64_t)(seconds * 1e9), __ATOMIC_RELAXED);
+}
+
+void count_token_types(uint8_t *types, size_t length) {
+	if (!stats_enabled) return;
+
+	// counted locally first so each type is only added atomically once
+	uint64_t counts[TOKEN_TYPES + 1] = { 0 };
+	for (size_t i = 0; i < length; i++) counts[types[i]]++;
+
+	// errors aren't tokens of any type
+	add_counts(stats.tokens, counts, TOKEN_TYPES);
+}
+
+static void print_bytes(FILE *file, uint64_t bytes) {
+	if (bytes < 1024) fprintf(file, "%10llu B ", (unsigned long long)bytes);
+	else if (bytes < 1024 * 1024) fprintf(file, "%10.1f KB", bytes / 1024.0);
+	else fprintf(file, "%10.1f MB", bytes / (1024.0 * 1024.0));
+}
+
+void print_stats(FILE *file, Stats *stats) {
+	fprintf(file, "stats:\n");
+
+	for (StatsPhase phase = 0; phase < STATS_PHASES; phase++) {
+		if (stats->phase_nanoseconds[phase] == 0) continue;
+		fprintf(file, "  %-12s %10.3f ms\n", stringify_phase(phase), stats->phase_nanoseconds[phase] / 1e6);
+	}
+
+	uint64_t tokens = 0;
+	for (TokenType type = 0; type < TOKEN_TYPES; type++) tokens += stats->tokens[type];
+
+	if (tokens > 0) {
+		double lex_seconds = stats->phase_nanoseconds[PHASE_LEX] / 1e9;
+		fprintf(file, "  tokens: %llu", (unsigned long long)tokens);
+		if (lex_seconds > 0) fprintf(file, " (%.1f million a second)", tokens / lex_seconds / 1e6);
+		fprintf(file, "\n");
+
+		for (TokenType type = 0; type < TOKEN_TYPES; type++) {
+			if (stats->tokens[type] == 0) continue;
+			fprintf(file, "    %-12s %10llu\n", stringify_token_type(type), (unsigned long long)stats->tokens[type]);
+		}
+	}
+
+	fprintf(file, "  allocations:\n");
+
+	for (StatsSubsystem subsystem = 0; subsystem < STATS_SUBSYSTEMS; subsystem++) {
+		fprintf(
+			file, "    %-12s %10llu  ", stringify_subsystem(subsystem),
+			(unsigned long long)stats->allocations[subsystem]
+		);
+		print_bytes(file, stats->bytes[subsystem]);
+		fprintf(file, "\n");
+	}
+
+	fprintf(file, "  peak rss:    ");
+	print_bytes(file, stats->peak_rss);
+	fprintf(file, "\n");
+}
@@ -0,0 +1,77 @@
+#ifndef INCLUDE_STATS_H
+#define INCLUDE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "lexer.h"
+
+// counters for --stats, which programs embedding the interpreter can read too.
+// nothing is counted unless stats_enabled is set, and then everything is added
+// atomically since files are parsed (and checked) on several threads at once
+
+typedef enum {
+	PHASE_READ, // loading the source
+	PHASE_CACHE, // hashing the source and reading or writing the cache
+	PHASE_PARSE, // lexing and parsing together
+	PHASE_LEX, // filling token streams, which is part of PHASE_PARSE
+	PHASE_OPTIMISE,
+	PHASE_COMPILE,
+	PHASE_RUN
+} StatsPhase;
+
+#define STATS_PHASES (PHASE_RUN + 1)
+
+// what memory was allocated for
+typedef enum {
+	STATS_LEXER, // including the symbol table, since names are interned as they're lexed
+	STATS_PARSER, // errors and the tables for parsing in parallel
+	STATS_AST, // everything in an arena (which includes the names of symbols)
+	STATS_COMPILER,
+	STATS_RUNTIME // the vm, strings and the jit
+} StatsSubsystem;
+
+#define STATS_SUBSYSTEMS (STATS_RUNTIME + 1)
+
+typedef struct {
+	uint64_t phase_nanoseconds[STATS_PHASES];
+	uint64_t tokens[TOKEN_TYPES];
+
+	// a realloc counts as allocating the whole new size, so bytes is the total
+	// asked for rather than how much was in use at once
+	uint64_t allocations[STATS_SUBSYSTEMS];
+	uint64_t bytes[STATS_SUBSYSTEMS];
+
+	size_t peak_rss; // in bytes, for the whole process
+} Stats;
+
+extern bool stats_enabled;
+
+extern void reset_stats(void);
+
+// a copy of the counters so far, with the peak rss filled in
+extern Stats read_stats(void);
+
+extern char *stringify_phase(StatsPhase phase);
+extern char *stringify_subsystem(StatsSubsystem subsystem);
+
+extern void record_alloc(StatsSubsystem subsystem, size_t bytes);
+
+// goes next to the ensure_alloc for anything worth counting
+static inline void count_alloc(StatsSubsystem subsystem, size_t bytes) {
+	if (stats_enabled) record_alloc(subsystem, bytes);
+}
+
+// phases are timed between these. start_phase returns 0 when stats are off
+extern double start_phase(void);
+extern void end_phase(StatsPhase phase, double start);
+extern void add_phase_time(StatsPhase phase, double seconds);
+
+// adds up the types of tokens that have just been lexed into a stream
+extern void count_token_types(uint8_t *types, size_t length);
+
+extern void print_stats(FILE *file, Stats *stats);
+
+#endif // INCLUDE_STATS_H
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "symbols.h"
+#include "utils.h"
+#include "stats.h"
+
+#define INITIAL_SLOTS 64
+
+SymbolTable new_symbol_table(void) {
+	uint32_t *slots = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+	uint32_t *hashes = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+	ensure_alloc(slots);
+	ensure_alloc(hashes);
+	count_alloc(STATS_LEXER, INITIAL_SLOTS * sizeof(uint32_t) * 2);
+
+	return (SymbolTable){
+		.names = NULL, .lengths = NULL, .length = 0, .capacity = 0,
+		.slots = slots, .hashes = hashes, .slots_capacity = INITIAL_SLOTS,
+		.arena = new_arena(4096)
+	};
+}
+
+void free_symbol_table(SymbolTable *symbols) {
+	free(symbols->names);
+	free(symbols->lengths);
+	free(symbols->slots);
+	free(symbols->hashes);
+	free_arena(&symbols->arena);
+}
+
+// FNV-1a over the lowercased name
+static uint32_t hash_name(char *name, size_t length) {
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)tolower(name[i]);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static bool names_match(char *lowercase_name, char *name, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		if (lowercase_name[i] != tolower(name[i]))
+			return false;
+
+	return true;
+}
+
+// puts a symbol into the first free slot for its hash
+static void insert_slot(SymbolTable *symbols, uint32_t hash, Symbol symbol) {
+	size_t mask = symbols->slots_capacity - 1;
+	size_t i = hash & mask;
+
+	while (symbols->slots[i] != 0) i = (i + 1) & mask;
+
+	symbols->slots[i] = symbol + 1;
+	symbols->hashes[i] = hash;
+}
+
+// doubles the table once it's half full to keep probe sequences short
+static void grow_slots(SymbolTable *symbols) {
+	uint32_t *old_slots = symbols->slots;
+	uint32_t *old_hashes = symbols->hashes;
+	size_t old_capacity = symbols->slots_capacity;
+
+	symbols->slots_capacity *= 2;
+	symbols->slots = calloc(symbols->slots_capacity, sizeof(uint32_t));
+	symbols->hashes = calloc(symbols->slots_capacity, sizeof(uint32_t));
+	ensure_alloc(symbols->slots);
+	ensure_alloc(symbols->hashes);
+	count_alloc(STATS_LEXER, symbols->slots_capacity * sizeof(uint32_t) * 2);
+
+	for (size_t i = 0; i < old_capacity; i++)
+		if (old_slots[i] != 0)
+			insert_slot(symbols, old_hashes[i], old_slots[i] - 1);
+
+	free(old_slots);
+	free(old_hashes);
+}
+
+Symbol intern_symbol(SymbolTable *symbols, char *name, size_t length) {
+	uint32_t hash = hash_name(name, length);
+	size_t mask = symbols->slots_capacity - 1;
+
+	for (size_t i = hash & mask; symbols->slots[i] != 0; i = (i + 1) & mask) {
+		Symbol symbol = symbols->slots[i] - 1;
+		if (
+			symbols->hashes[i] == hash &&
+			symbols->lengths[symbol] == length &&
+			names_match(symbols->names[symbol], name, length)
+		) return symbol;
+	}
+
+	// it's a new name so give it the next id
+	if (symbols->length == symbols->capacity) {
+		symbols->capacity = symbols->capacity == 0 ? 16 : symbols->capacity * 2;
+		symbols->names = realloc(symbols->names, symbols->capacity * sizeof(char *));
+		symbols->lengths = realloc(symbols->lengths, symbols->capacity * sizeof(size_t));
+		ensure_alloc(symbols->names);
+		ensure_alloc(symbols->lengths);
+		count_alloc(STATS_LEXER, symbols->capacity * (sizeof(char *) + sizeof(size_t)));
+	}
+
+	char *lowercase_name = arena_alloc(&symbols->arena, length + 1);
+	for (size_t i = 0; i < length; i++) lowercase_name[i] = tolower(name[i]);
+	lowercase_name[length] = '\0';
+
+	Symbol symbol = symbols->length++;
+	symbols->names[symbol] = lowercase_name;
+	symbols->lengths[symbol] = length;
+
+	if (symbols->length * 2 > symbols->slots_capacity) grow_slots(symbols);
+	insert_slot(symbols, hash, symbol);
+
+	return symbol;
+}
+
+char *symbol_name(SymbolTable *symbols, Symbol symbol) {
+	return symbols->names[symbol];
+}
+
+bool symbol_is_string(SymbolTable *symbols, Symbol symbol) {
+	return symbols->names[symbol][symbols->lengths[symbol] - 1] == '$';
+}
@@ -0,0 +1,36 @@
+#ifndef INCLUDE_SYMBOLS_H
+#define INCLUDE_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+// names are interned as they're lexed, so every distinct name (ignoring case)
+// gets a dense id which the runtime can use to index a flat array of variables
+
+typedef uint32_t Symbol;
+
+typedef struct {
+	char **names; // lowercase names indexed by symbol
+	size_t *lengths;
+	size_t length, capacity;
+
+	uint32_t *slots; // open addressing table of symbol + 1 (0 means empty)
+	uint32_t *hashes;
+	size_t slots_capacity; // always a power of two
+
+	Arena arena; // the names themselves
+} SymbolTable;
+
+extern SymbolTable new_symbol_table(void);
+extern void free_symbol_table(SymbolTable *symbols);
+
+extern Symbol intern_symbol(SymbolTable *symbols, char *name, size_t length);
+extern char *symbol_name(SymbolTable *symbols, Symbol symbol);
+
+// variables ending in a dollar sign hold strings
+extern bool symbol_is_string(SymbolTable *symbols, Symbol symbol);
+
+#endif  // INCLUDE_SYMBOLS_H
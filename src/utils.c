@@ -2,10 +2,16 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
-#include <math.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utils.h"
+#include "stats.h"
 
 void ensure_alloc(void *ptr) {
 	if (ptr == NULL) {
@@ -14,103 +20,152 @@ void ensure_alloc(void *ptr) {
 	}
 }
 
-char *read_file(char *path) {
-	FILE *file = fopen(path, "r");
+double monotonic_seconds(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
 
-	if (file == NULL) {
-		printf("Error: could not read file %s\n", path);
-		exit(EXIT_FAILURE);
+// reads everything from a file descriptor into a null terminated buffer, for
+// things like pipes which can't be mapped or don't know their size up front.
+// returns NULL if it couldn't be read
+static char *read_all(int fd, size_t *length) {
+	size_t capacity = 64 * 1024;
+	size_t used = 0;
+	char *buffer = malloc(capacity + 1);
+	ensure_alloc(buffer);
+
+	while (true) {
+		if (used == capacity) {
+			capacity *= 2;
+			buffer = realloc(buffer, capacity + 1);
+			ensure_alloc(buffer);
+		}
+
+		ssize_t amount_read = read(fd, buffer + used, capacity - used);
+
+		if (amount_read == 0) break;
+		if (amount_read < 0) {
+			if (errno == EINTR) continue;
+			free(buffer);
+			return NULL;
+		}
+
+		used += amount_read;
 	}
 
-	// go to the end of the file, see how long it is, then go back
-	fseek(file, 0, SEEK_END);
-	size_t file_length = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	buffer[used] = '\0';
+	*length = used;
 
-	// 0.5GB (probably don't want to load that into memory)
-	const size_t MAX_FILE_SIZE = 500000000;
+	return buffer;
+}
 
-	if (file_length > MAX_FILE_SIZE) {
-		printf("Error: file must be less than 0.5GB\n");
-		exit(EXIT_FAILURE);
+bool try_load_source(char *path, SourceFile *source) {
+	bool is_stdin = strcmp(path, "-") == 0;
+	int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+
+	if (fd < 0) return false;
+
+	struct stat file_stat;
+	bool is_file = fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+
+	if (!is_file || file_stat.st_size == 0) {
+		*source = (SourceFile){ .mapped = false, .mapped_length = 0 };
+		if (is_file) source->modified = file_stat.st_mtim;
+		source->code = read_all(fd, &source->length);
+		if (!is_stdin) close(fd);
+		return source->code != NULL;
 	}
 
-	char *buffer = malloc(file_length + 1);
-	ensure_alloc(buffer);
+	size_t length = file_stat.st_size;
+	size_t page_size = sysconf(_SC_PAGESIZE);
 
-	// read file into memory
-	size_t amount_read = fread(buffer, 1, file_length, file);
-	fclose(file);
+	// the lexer relies on the code ending in a null byte. the kernel zeroes the
+	// rest of the file's last page, but if the file fills that page exactly then
+	// there's nothing after it, so reserve an extra zeroed page to map it into
+	size_t mapped_length = (length / page_size + 1) * page_size;
 
-	buffer[file_length] = '\0';
+	char *reserved = mmap(NULL, mapped_length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *code = reserved == MAP_FAILED
+		? MAP_FAILED
+		: mmap(reserved, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
 
-	if (amount_read != file_length) {
-		printf("Error: did not manage to read the whole file.\n");
-		exit(EXIT_FAILURE);
+	if (code == MAP_FAILED) {
+		if (reserved != MAP_FAILED) munmap(reserved, mapped_length);
+
+		// fall back to reading it in if it can't be mapped for some reason
+		*source = (SourceFile){ .mapped = false, .mapped_length = 0, .modified = file_stat.st_mtim };
+		source->code = read_all(fd, &source->length);
+		close(fd);
+		return source->code != NULL;
 	}
 
-	return buffer;
+	close(fd);
+	madvise(code, length, MADV_SEQUENTIAL);
+
+	*source = (SourceFile){ code, length, true, mapped_length, file_stat.st_mtim };
+	return true;
 }
 
-char *alloc_empty_str(void) {
-	char *string = malloc(1);
-	ensure_alloc(string);
-	string[0] = '\0';
-	return string;
+SourceFile load_source(char *path) {
+	double start = start_phase();
+	SourceFile source;
+
+	if (!try_load_source(path, &source)) {
+		printf("Error: could not read file %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	end_phase(PHASE_READ, start);
+	return source;
 }
 
-void append_str(char **dest, char *src) {
-	*dest = realloc(*dest, strlen(*dest) + strlen(src) + 1);
-	ensure_alloc(*dest);
-	strcat(*dest, src);
+void free_source(SourceFile source) {
+	if (source.mapped) munmap(source.code, source.mapped_length);
+	else free(source.code);
 }
 
-void append_char(char **dest, char ch) {
-	size_t dest_len = strlen(*dest);
-	*dest = realloc(*dest, dest_len + 2);
-	ensure_alloc(*dest);
+size_t grow_capacity(size_t capacity, size_t needed) {
+	if (needed <= capacity) return capacity;
 
-	(*dest)[dest_len] = ch;
-	(*dest)[dest_len + 1] = '\0';
+	capacity = capacity < 16 ? 16 : capacity * 2;
+	return capacity < needed ? needed : capacity;
 }
 
-void append_str_and_free(char **dest, char *src) {
-	*dest = realloc(*dest, strlen(*dest) + strlen(src) + 1);
-	ensure_alloc(*dest);
-	strcat(*dest, src);
-	free(src);
+StringBuilder new_string_builder(size_t capacity) {
+	char *chars = malloc(capacity + 1);
+	ensure_alloc(chars);
+	chars[0] = '\0';
+	return (StringBuilder){ chars, 0, capacity };
 }
 
-char *num_as_str(size_t number) {
-	size_t string_len;
-	if (number == 0) string_len = 2;
-	else string_len = (int)log10(number) + 2;
-
-	char *string = malloc(string_len);
-	ensure_alloc(string);
-	snprintf(string, string_len, "%zu\n", number);
+static void reserve(StringBuilder *builder, size_t length) {
+	size_t needed = builder->length + length;
+	if (needed <= builder->capacity) return;
 
-	return string;
+	builder->capacity = grow_capacity(builder->capacity, needed);
+	builder->chars = realloc(builder->chars, builder->capacity + 1);
+	ensure_alloc(builder->chars);
 }
 
-char *char_as_str(char ch) {
-	return (char[]){ ch, '\0' };
+void builder_append(StringBuilder *builder, const char *chars, size_t length) {
+	reserve(builder, length);
+	memcpy(builder->chars + builder->length, chars, length);
+	builder->length += length;
+	builder->chars[builder->length] = '\0';
 }
 
-BufferedString empty_buffered_string(size_t step) {
-	char *buffer = malloc(step + 1);
-	ensure_alloc(buffer);
-	buffer[0] = '\0';
-	return (BufferedString){ buffer, step, 0, step };
+void builder_append_str(StringBuilder *builder, const char *string) {
+	builder_append(builder, string, strlen(string));
 }
 
-void buffered_string_append_char(BufferedString *str, char ch) {
-	if (str->length == str->capacity) {
-		// allocate an extra <step> bytes and add one for null byte
-		str->buffer = realloc(str->buffer, (str->capacity / str->step + 1) * str->step + 1);
-		str->capacity += str->step;
-	}
+void builder_append_char(StringBuilder *builder, char ch) {
+	reserve(builder, 1);
+	builder->chars[builder->length++] = ch;
+	builder->chars[builder->length] = '\0';
+}
 
-	str->buffer[str->length++] = ch;
-	str->buffer[str->length] = '\0';
+void builder_append_number(StringBuilder *builder, size_t number) {
+	char digits[24];
+	builder_append(builder, digits, snprintf(digits, sizeof(digits), "%zu", number));
 }
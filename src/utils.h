@@ -3,24 +3,53 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <time.h>
 
 extern void ensure_alloc(void *ptr);
-extern char *read_file(char *path);
-extern char *alloc_empty_str(void);
-extern void append_str(char **dest, char *src);
-extern void append_char(char **dest, char ch);
-extern void append_str_and_free(char **dest, char *src);
-extern char *num_as_str(size_t number);
-extern char *char_as_str(char ch);
 
+// seconds since some fixed point, for timing things
+extern double monotonic_seconds(void);
+
+// the code for a program, which always ends in a null byte. regular files are
+// memory mapped, anything else (pipes, or stdin if the path is "-") is read in
 typedef struct {
-	char *buffer;
-	size_t capacity;
+	char *code;
+	size_t length;
+	bool mapped;
+	size_t mapped_length;
+	struct timespec modified; // zero unless it's a regular file
+} SourceFile;
+
+extern SourceFile load_source(char *path);
+
+// the same as load_source, but returns false instead of exiting if the file
+// can't be read
+extern bool try_load_source(char *path, SourceFile *source);
+extern void free_source(SourceFile source);
+
+// a view of part of a string, which isn't necessarily null terminated
+typedef struct {
+	char *chars;
+	size_t length;
+} StringSlice;
+
+// the capacity to grow something to so it fits needed, at least doubling it
+// each time so that filling it up one piece at a time is linear overall
+extern size_t grow_capacity(size_t capacity, size_t needed);
+
+// a string that keeps track of its length and how much room it has, so
+// appending to it doesn't have to look for the end or reallocate every time.
+// chars is always null terminated
+typedef struct {
+	char *chars;
 	size_t length;
-	size_t step;
-} BufferedString;
+	size_t capacity;
+} StringBuilder;
 
-extern BufferedString empty_buffered_string(size_t step);
-extern void buffered_string_append_char(BufferedString *str, char ch);
+extern StringBuilder new_string_builder(size_t capacity);
+extern void builder_append(StringBuilder *builder, const char *chars, size_t length);
+extern void builder_append_str(StringBuilder *builder, const char *string);
+extern void builder_append_char(StringBuilder *builder, char ch);
+extern void builder_append_number(StringBuilder *builder, size_t number);
 
 #endif  // INCLUDE_UTILS_H
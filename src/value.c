@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "value.h"
+#include "output.h"
+#include "stats.h"
+
+static HeapString *new_heap_string(size_t capacity) {
+	HeapString *string = malloc(sizeof(HeapString) + capacity + 1);
+	ensure_alloc(string);
+	count_alloc(STATS_RUNTIME, sizeof(HeapString) + capacity + 1);
+
+	string->refcount = 1;
+	string->length = 0;
+	string->capacity = capacity;
+	return string;
+}
+
+static Value make_string(const char *chars, size_t length, uint64_t tag) {
+	if (length <= SHORT_STRING_MAX) {
+		uint64_t payload = 0;
+		for (size_t i = 0; i < length; i++) payload |= (uint64_t)(uint8_t)chars[i] << (i * 8);
+		return VALUE_SHORT_STRING_TAG | payload;
+	}
+
+	HeapString *string = new_heap_string(length);
+	memcpy(string->chars, chars, length);
+	string->chars[length] = '\0';
+	string->length = length;
+
+	return tag | (uint64_t)(uintptr_t)string;
+}
+
+Value string_value(const char *chars, size_t length) {
+	return make_string(chars, length, VALUE_HEAP_STRING_TAG);
+}
+
+Value constant_string_value(const char *chars, size_t length) {
+	return make_string(chars, length, VALUE_CONSTANT_STRING_TAG);
+}
+
+void free_heap_string(HeapString *string) {
+	free(string);
+}
+
+void free_constant_string(Value value) {
+	if (!value_is_short_string(value)) free(value_heap_string(value));
+}
+
+// the chars of a string with a null on the end, for comparing with strcmp
+static inline const char *null_terminated(Value value, char *buffer) {
+	if (!value_is_short_string(value)) return value_heap_string(value)->chars;
+
+	uint64_t payload = value & VALUE_PAYLOAD_MASK;
+	for (size_t i = 0; i <= SHORT_STRING_MAX; i++) buffer[i] = payload >> (i * 8);
+	return buffer;
+}
+
+int compare_strings(Value lhs, Value rhs) {
+	if (lhs == rhs) return 0;
+
+	// with their bytes swapped so the first char is the highest, two short
+	// strings compare in the same order as their payloads, since the zeros
+	// after a shorter string sort before any char
+	if (value_is_short_string(lhs) && value_is_short_string(rhs)) {
+		uint64_t a = __builtin_bswap64(lhs & VALUE_PAYLOAD_MASK), b = __builtin_bswap64(rhs & VALUE_PAYLOAD_MASK);
+		return (a > b) - (a < b);
+	}
+
+	char lhs_buffer[SHORT_STRING_MAX + 1], rhs_buffer[SHORT_STRING_MAX + 1];
+	return strcmp(null_terminated(lhs, lhs_buffer), null_terminated(rhs, rhs_buffer));
+}
+
+Value concat_strings(Value lhs, Value rhs) {
+	char lhs_buffer[SHORT_STRING_MAX], rhs_buffer[SHORT_STRING_MAX];
+	StringSlice a = value_string(lhs, lhs_buffer), b = value_string(rhs, rhs_buffer);
+	size_t length = a.length + b.length;
+
+	if (length > STRING_MAX_LENGTH) {
+		flush_output();
+		printf("Error: a string can't be longer than %u chars\n", STRING_MAX_LENGTH);
+		exit(EXIT_FAILURE);
+	}
+
+	HeapString *string;
+
+	if (length <= SHORT_STRING_MAX) {
+		// both must be short too, so there's nothing to release
+		Value joined = lhs;
+		for (size_t i = 0; i < b.length; i++) joined |= (uint64_t)(uint8_t)b.chars[i] << ((a.length + i) * 8);
+		return joined;
+	} else if (value_is_heap_string(lhs) && value_heap_string(lhs)->refcount == 1) {
+		string = value_heap_string(lhs);
+
+		if (length > string->capacity) {
+			size_t capacity = grow_capacity(string->capacity, length);
+			if (capacity > STRING_MAX_LENGTH) capacity = STRING_MAX_LENGTH;
+
+			string = realloc(string, sizeof(HeapString) + capacity + 1);
+			ensure_alloc(string);
+			count_alloc(STATS_RUNTIME, sizeof(HeapString) + capacity + 1);
+			string->capacity = capacity;
+		}
+	} else {
+		string = new_heap_string(length);
+		memcpy(string->chars, a.chars, a.length);
+		release_value(lhs);
+	}
+
+	memcpy(string->chars + a.length, b.chars, b.length);
+	string->chars[length] = '\0';
+	string->length = length;
+	release_value(rhs);
+
+	return VALUE_HEAP_STRING_TAG | (uint64_t)(uintptr_t)string;
+}
@@ -0,0 +1,118 @@
+#ifndef INCLUDE_VALUE_H
+#define INCLUDE_VALUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "utils.h"
+
+// every runtime value is a single 64 bit word. numbers are just the bits of
+// the double, and everything else hides in the nans: when the sign, exponent
+// and quiet bits are all set, the next three bits are a tag and the bottom 48
+// are the payload. tag 0 is left for the nan the hardware makes (0/0 and so
+// on), so arithmetic can never produce something that looks like a string:
+//
+//   tag 1  pointer to a refcounted HeapString (user space pointers fit in
+//          48 bits)
+//   tag 2  string of up to 6 chars stored in the payload, first char in the
+//          lowest byte. strings can't contain null bytes, so the length is
+//          how many bytes up to the last non zero one
+//   tag 3  pointer to a HeapString that's a constant in the program. these
+//          live until the program finishes, so they aren't counted at all
+typedef uint64_t Value;
+
+#define VALUE_HEAP_STRING_TAG ((uint64_t)0xFFF9 << 48)
+#define VALUE_SHORT_STRING_TAG ((uint64_t)0xFFFA << 48)
+#define VALUE_CONSTANT_STRING_TAG ((uint64_t)0xFFFB << 48)
+#define VALUE_PAYLOAD_MASK (((uint64_t)1 << 48) - 1)
+
+#define SHORT_STRING_MAX 6
+
+// the longest a string can be, so lengths fit in a HeapString
+#define STRING_MAX_LENGTH UINT32_MAX
+
+// strings have room to grow like a StringBuilder, so appending to one nothing
+// else refers to doesn't need a copy
+typedef struct {
+	uint32_t refcount;
+	uint32_t length;
+	uint32_t capacity;
+	char chars[]; // null terminated
+} HeapString;
+
+static inline Value number_value(double number) {
+	Value value;
+	memcpy(&value, &number, sizeof(Value));
+	return value;
+}
+
+static inline double value_number(Value value) {
+	double number;
+	memcpy(&number, &value, sizeof(double));
+	return number;
+}
+
+// all the string tags are above every number and the hardware nan
+static inline bool value_is_string(Value value) {
+	return value >= VALUE_HEAP_STRING_TAG;
+}
+
+static inline bool value_is_heap_string(Value value) {
+	return (value & ~VALUE_PAYLOAD_MASK) == VALUE_HEAP_STRING_TAG;
+}
+
+static inline bool value_is_short_string(Value value) {
+	return (value & ~VALUE_PAYLOAD_MASK) == VALUE_SHORT_STRING_TAG;
+}
+
+// works for constant strings too
+static inline HeapString *value_heap_string(Value value) {
+	return (HeapString *)(uintptr_t)(value & VALUE_PAYLOAD_MASK);
+}
+
+// makes a string with one reference, which whoever called this owns
+extern Value string_value(const char *chars, size_t length);
+
+// makes a string constant, which has to be freed with free_constant_string
+// once nothing can be using it any more
+extern Value constant_string_value(const char *chars, size_t length);
+extern void free_constant_string(Value value);
+
+extern void free_heap_string(HeapString *string);
+
+// only heap strings are counted, so these do nothing for anything else
+static inline void retain_value(Value value) {
+	if (value_is_heap_string(value)) value_heap_string(value)->refcount++;
+}
+
+static inline void release_value(Value value) {
+	if (value_is_heap_string(value) && --value_heap_string(value)->refcount == 0)
+		free_heap_string(value_heap_string(value));
+}
+
+// the chars of a string value. short strings are copied out into buffer
+// (which needs SHORT_STRING_MAX chars) so the result isn't null terminated
+static inline StringSlice value_string(Value value, char *buffer) {
+	if (!value_is_short_string(value)) {
+		HeapString *string = value_heap_string(value);
+		return (StringSlice){ string->chars, string->length };
+	}
+
+	uint64_t payload = value & VALUE_PAYLOAD_MASK;
+	for (size_t i = 0; i < SHORT_STRING_MAX; i++) buffer[i] = payload >> (i * 8);
+
+	// the length is up to and including the highest non zero byte
+	size_t length = payload == 0 ? 0 : (64 - __builtin_clzll(payload) + 7) / 8;
+	return (StringSlice){ buffer, length };
+}
+
+// like strcmp, but for string values
+extern int compare_strings(Value lhs, Value rhs);
+
+// joins two strings, taking over the reference to each. if lhs is a heap
+// string nothing else refers to, rhs is appended to it in place
+extern Value concat_strings(Value lhs, Value rhs);
+
+#endif  // INCLUDE_VALUE_H
@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "vm.h"
+#include "jit.h"
+#include "profile.h"
+#include "stats.h"
+#include "output.h"
+#include "builtins.h"
+#include "utils.h"
+
+// gcc and clang let us jump straight to the next handler instead of going back
+// through the switch, which saves a bounds check and predicts much better
+#if defined(__GNUC__)
+#define USE_COMPUTED_GOTO
+#endif
+
+void print_value(Value value) {
+	if (value_is_string(value)) {
+		char buffer[SHORT_STRING_MAX];
+		StringSlice string = value_string(value, buffer);
+		output_bytes(string.chars, string.length);
+	} else output_number(value_number(value));
+}
+
+Value *new_variables(Program *program) {
+	Value *variables = malloc(sizeof(Value) * program->variables_length);
+	ensure_alloc(variables);
+	count_alloc(STATS_RUNTIME, sizeof(Value) * program->variables_length);
+
+	for (size_t i = 0; i < program->variables_length; i++) {
+		// a program loaded from a cache could have an empty name
+		char *name = program->variables[i];
+		size_t name_length = strlen(name);
+		if (name_length > 0 && name[name_length - 1] == '$')
+			variables[i] = string_value("", 0);
+		else
+			variables[i] = number_value(0);
+	}
+
+	return variables;
+}
+
+void free_variables(Program *program, Value *variables) {
+	for (size_t i = 0; i < program->variables_length; i++) release_value(variables[i]);
+	free(variables);
+}
+
+void run_program(Program *program) {
+	Value *variables = new_variables(program);
+	run_program_with_variables(program, variables);
+	free_variables(program, variables);
+}
+
+void run_program_with_variables(Program *program, Value *variables) {
+	double start = start_phase();
+
+	// with the jit on, the code that runs is its copy with entries patched in
+	Jit *jit = new_jit(program, jit_mode);
+	Instruction *code = jit != NULL ? jit->code : program->code;
+
+	// and the profiler patches its entries in on top of whatever would run
+	Profile *profile = active_profile;
+	if (profile != NULL) code = start_profile(profile, code);
+
+	// the compiler works out how deep the stack can get so it never needs to grow
+	Value *stack = malloc(sizeof(Value) * (program->max_stack_depth + 1));
+	ensure_alloc(stack);
+	count_alloc(STATS_RUNTIME, sizeof(Value) * (program->max_stack_depth + 1));
+
+	// string constants are made into values once up front, so pushing one is
+	// just a copy
+	Value *strings = malloc(sizeof(Value) * (program->strings_length + 1));
+	ensure_alloc(strings);
+	count_alloc(STATS_RUNTIME, sizeof(Value) * (program->strings_length + 1));
+
+	for (size_t i = 0; i < program->strings_length; i++)
+		strings[i] = constant_string_value(program->strings[i], strlen(program->strings[i]));
+
+	Value *top = stack; // points to the slot after the top value
+	Instruction *ip = code;
+	Instruction instruction;
+
+	// where each GOSUB has to come back to. this one does have to grow, since
+	// how deep subroutines go isn't known until they run
+	size_t *returns = NULL;
+	size_t returns_length = 0, returns_capacity = 0;
+
+	#define PUSH(v) (*top++ = (v))
+	#define POP() (*--top)
+	#define PEEK() (top[-1])
+	#define NUMBER(n) number_value(n)
+
+	#define BINARY_OP(op) { \
+		double rhs = value_number(POP()); \
+		PEEK() = NUMBER(value_number(PEEK()) op rhs); \
+	}
+
+	// true is -1 (all bits set) like in other BASICs, and strings compare by
+	// their chars
+	#define COMPARE(op) { \
+		Value rhs = POP(), lhs = PEEK(); \
+		bool result; \
+		if (value_is_string(rhs)) { \
+			result = compare_strings(lhs, rhs) op 0; \
+			release_value(lhs); \
+			release_value(rhs); \
+		} else result = value_number(lhs) op value_number(rhs); \
+		PEEK() = NUMBER(result ? -1 : 0); \
+	}
+
+#ifdef USE_COMPUTED_GOTO
+	static void *handlers[] = {
+		[OP_PUSH_NUMBER] = &&handle_OP_PUSH_NUMBER,
+		[OP_PUSH_STRING] = &&handle_OP_PUSH_STRING,
+		[OP_LOAD_VAR] = &&handle_OP_LOAD_VAR,
+		[OP_STORE_VAR] = &&handle_OP_STORE_VAR,
+		[OP_LOAD_STRING_VAR] = &&handle_OP_LOAD_STRING_VAR,
+		[OP_STORE_STRING_VAR] = &&handle_OP_STORE_STRING_VAR,
+		[OP_TAKE_STRING_VAR] = &&handle_OP_TAKE_STRING_VAR,
+		[OP_ADD] = &&handle_OP_ADD,
+		[OP_SUBTRACT] = &&handle_OP_SUBTRACT,
+		[OP_MULTIPLY] = &&handle_OP_MULTIPLY,
+		[OP_DIVIDE] = &&handle_OP_DIVIDE,
+		[OP_POWER] = &&handle_OP_POWER,
+		[OP_EQUAL] = &&handle_OP_EQUAL,
+		[OP_NOT_EQUAL] = &&handle_OP_NOT_EQUAL,
+		[OP_LESS] = &&handle_OP_LESS,
+		[OP_LESS_EQUAL] = &&handle_OP_LESS_EQUAL,
+		[OP_GREATER] = &&handle_OP_GREATER,
+		[OP_GREATER_EQUAL] = &&handle_OP_GREATER_EQUAL,
+		[OP_NEGATE] = &&handle_OP_NEGATE,
+		[OP_CONCAT] = &&handle_OP_CONCAT,
+		[OP_CALL_BUILTIN] = &&handle_OP_CALL_BUILTIN,
+		[OP_PRINT] = &&handle_OP_PRINT,
+		[OP_PRINT_ZONE] = &&handle_OP_PRINT_ZONE,
+		[OP_PRINT_NEWLINE] = &&handle_OP_PRINT_NEWLINE,
+		[OP_JUMP] = &&handle_OP_JUMP,
+		[OP_JUMP_IF_FALSE] = &&handle_OP_JUMP_IF_FALSE,
+		[OP_JUMP_IF_TRUE] = &&handle_OP_JUMP_IF_TRUE,
+		[OP_GOSUB] = &&handle_OP_GOSUB,
+		[OP_RETURN] = &&handle_OP_RETURN,
+		[OP_HALT] = &&handle_OP_HALT,
+		[OP_JIT_ENTRY] = &&handle_OP_JIT_ENTRY,
+		[OP_PROFILE_ENTRY] = &&handle_OP_PROFILE_ENTRY
+	};
+
+	#define CASE(opcode) handle_##opcode
+	#define DISPATCH() instruction = *ip++; goto *handlers[instruction.opcode]
+	#define REDISPATCH() goto *handlers[instruction.opcode]
+
+	DISPATCH();
+#else
+	#define CASE(opcode) case opcode
+	#define DISPATCH() break
+	#define REDISPATCH() goto redispatch
+
+	while (true) {
+		instruction = *ip++;
+	redispatch:
+		switch (instruction.opcode) {
+#endif
+			CASE(OP_PUSH_NUMBER):
+				PUSH(NUMBER(program->numbers[instruction.operand]));
+				DISPATCH();
+			CASE(OP_PUSH_STRING):
+				PUSH(strings[instruction.operand]);
+				DISPATCH();
+			CASE(OP_LOAD_VAR):
+				PUSH(variables[instruction.operand]);
+				DISPATCH();
+			CASE(OP_STORE_VAR):
+				variables[instruction.operand] = POP();
+				DISPATCH();
+			CASE(OP_LOAD_STRING_VAR):
+				retain_value(variables[instruction.operand]);
+				PUSH(variables[instruction.operand]);
+				DISPATCH();
+			CASE(OP_STORE_STRING_VAR):
+				release_value(variables[instruction.operand]);
+				variables[instruction.operand] = POP();
+				DISPATCH();
+			CASE(OP_TAKE_STRING_VAR):
+				PUSH(variables[instruction.operand]);
+				variables[instruction.operand] = string_value("", 0);
+				DISPATCH();
+			CASE(OP_ADD): BINARY_OP(+) DISPATCH();
+			CASE(OP_SUBTRACT): BINARY_OP(-) DISPATCH();
+			CASE(OP_MULTIPLY): BINARY_OP(*) DISPATCH();
+			CASE(OP_DIVIDE): BINARY_OP(/) DISPATCH();
+			CASE(OP_POWER): {
+				double rhs = value_number(POP());
+				PEEK() = NUMBER(pow(value_number(PEEK()), rhs));
+				DISPATCH();
+			}
+			CASE(OP_EQUAL): COMPARE(==) DISPATCH();
+			CASE(OP_NOT_EQUAL): COMPARE(!=) DISPATCH();
+			CASE(OP_LESS): COMPARE(<) DISPATCH();
+			CASE(OP_LESS_EQUAL): COMPARE(<=) DISPATCH();
+			CASE(OP_GREATER): COMPARE(>) DISPATCH();
+			CASE(OP_GREATER_EQUAL): COMPARE(>=) DISPATCH();
+			CASE(OP_NEGATE):
+				PEEK() = NUMBER(-value_number(PEEK()));
+				DISPATCH();
+			CASE(OP_CONCAT): {
+				Value rhs = POP();
+				PEEK() = concat_strings(PEEK(), rhs);
+				DISPATCH();
+			}
+			CASE(OP_CALL_BUILTIN):
+				// every builtin takes exactly one number at the moment
+				PEEK() = NUMBER(builtins[instruction.operand].function(value_number(PEEK())));
+				DISPATCH();
+			CASE(OP_PRINT): {
+				Value value = POP();
+				print_value(value);
+				release_value(value);
+				DISPATCH();
+			}
+			CASE(OP_PRINT_ZONE):
+				output_zone();
+				DISPATCH();
+			CASE(OP_PRINT_NEWLINE):
+				output_char('\n');
+				DISPATCH();
+			CASE(OP_JUMP):
+				ip = code + instruction.operand;
+				DISPATCH();
+			CASE(OP_JUMP_IF_FALSE):
+				if (value_number(POP()) == 0) ip = code + instruction.operand;
+				DISPATCH();
+			CASE(OP_JUMP_IF_TRUE):
+				if (value_number(POP()) != 0) ip = code + instruction.operand;
+				DISPATCH();
+			CASE(OP_GOSUB):
+				if (returns_length == returns_capacity) {
+					returns_capacity = returns_capacity == 0 ? 64 : returns_capacity * 2;
+					returns = realloc(returns, sizeof(size_t) * returns_capacity);
+					ensure_alloc(returns);
+					count_alloc(STATS_RUNTIME, sizeof(size_t) * returns_capacity);
+				}
+
+				returns[returns_length++] = ip - code;
+				ip = code + instruction.operand;
+				if (profile != NULL) profile_call(profile, instruction.operand);
+				DISPATCH();
+			CASE(OP_RETURN):
+				if (returns_length == 0) {
+					flush_output();
+					printf("Error: RETURN without GOSUB\n");
+					exit(EXIT_FAILURE);
+				}
+
+				ip = code + returns[--returns_length];
+				if (profile != NULL) profile_return(profile);
+				DISPATCH();
+			CASE(OP_JIT_ENTRY): {
+				JitRegion *region = &jit->regions[instruction.operand];
+
+				if (region->function == NULL && !region->failed && ++region->hits >= jit->threshold)
+					compile_region(jit, region);
+
+				if (region->function != NULL) {
+					region->function(variables, program->numbers);
+					ip = code + region->end;
+					DISPATCH();
+				}
+
+				// until it's compiled, carry on with the instruction the entry replaced
+				instruction = region->first;
+				REDISPATCH();
+			}
+			CASE(OP_PROFILE_ENTRY):
+				enter_statement(profile, instruction.operand);
+				instruction = profile->statements[instruction.operand].first;
+				REDISPATCH();
+			CASE(OP_HALT):
+				goto halt;
+#ifndef USE_COMPUTED_GOTO
+		}
+	}
+#endif
+
+halt:
+	if (profile != NULL) stop_profile(profile);
+	flush_output();
+
+	for (size_t i = 0; i < program->strings_length; i++) free_constant_string(strings[i]);
+	free(strings);
+
+	free(returns);
+	free(stack);
+	free_jit(jit);
+	end_phase(PHASE_RUN, start);
+
+	#undef PUSH
+	#undef POP
+	#undef PEEK
+	#undef NUMBER
+	#undef BINARY_OP
+	#undef COMPARE
+	#undef CASE
+	#undef DISPATCH
+	#undef REDISPATCH
+}
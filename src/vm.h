@@ -0,0 +1,19 @@
+#ifndef INCLUDE_VM_H
+#define INCLUDE_VM_H
+
+#include "compiler.h"
+#include "value.h"
+
+extern void print_value(Value value);
+
+// numeric variables start as 0 and string variables as ""
+extern Value *new_variables(Program *program);
+extern void free_variables(Program *program, Value *variables);
+
+// runs a compiled program from start to finish
+extern void run_program(Program *program);
+
+// the same, but with variables the caller owns so they can be looked at after
+extern void run_program_with_variables(Program *program, Value *variables);
+
+#endif  // INCLUDE_VM_H
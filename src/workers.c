@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "workers.h"
+#include "utils.h"
+
+typedef struct {
+	atomic_size_t next_task;
+	size_t task_count;
+	TaskFunction function;
+	void *context;
+} TaskQueue;
+
+size_t default_thread_count(void) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus < 1 ? 1 : (size_t)cpus;
+}
+
+static void *work(void *arg) {
+	TaskQueue *queue = arg;
+
+	while (true) {
+		size_t task = atomic_fetch_add(&queue->next_task, 1);
+		if (task >= queue->task_count) break;
+		queue->function(queue->context, task);
+	}
+
+	return NULL;
+}
+
+void run_tasks(size_t task_count, size_t thread_count, TaskFunction function, void *context) {
+	TaskQueue queue = { 0, task_count, function, context };
+
+	if (thread_count > task_count) thread_count = task_count;
+	if (thread_count <= 1) {
+		work(&queue);
+		return;
+	}
+
+	// the calling thread does its share too, so one fewer needs starting
+	pthread_t *threads = malloc(sizeof(pthread_t) * (thread_count - 1));
+	ensure_alloc(threads);
+
+	size_t started = 0;
+	for (; started < thread_count - 1; started++)
+		if (pthread_create(&threads[started], NULL, work, &queue) != 0) break;
+
+	work(&queue);
+
+	for (size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
@@ -0,0 +1,18 @@
+#ifndef INCLUDE_WORKERS_H
+#define INCLUDE_WORKERS_H
+
+#include <stddef.h>
+
+typedef void (*TaskFunction)(void *context, size_t task);
+
+// the number of cpus available, for when the user hasn't asked for a number
+// of threads
+extern size_t default_thread_count(void);
+
+// calls function once for each task from 0 to task_count - 1, spread across
+// thread_count threads (including the calling one), and returns once they've
+// all finished. threads take the next task as soon as they're done with one,
+// so uneven tasks still balance out
+extern void run_tasks(size_t task_count, size_t thread_count, TaskFunction function, void *context);
+
+#endif  // INCLUDE_WORKERS_H